@@ -0,0 +1,200 @@
+#pragma once
+
+#include "arch/x86/instr.h"
+#include "common.h"
+#include "io.h"
+#include <cstddef>
+#include <cstdint>
+#include <expected.h>
+#include <optional>
+
+namespace sbrt::x86
+{
+    /**
+     * General purpose registers, in hardware encoding order
+     */
+    enum class gpr : uint8_t
+    {
+        RAX,
+        RCX,
+        RDX,
+        RBX,
+        RSP,
+        RBP,
+        RSI,
+        RDI,
+        R8,
+        R9,
+        R10,
+        R11,
+        R12,
+        R13,
+        R14,
+        R15,
+        NONE = 0xff
+    };
+
+    // never handed out by register allocation, the encoder uses it to materialize immediates that have no short form
+    inline static constexpr gpr SCRATCH_REGISTER = gpr::R11;
+
+    /**
+     * Low level x86-64 instruction emitter over a caller supplied buffer. It never allocates; running out of space
+     * sets the overflow flag and drops further bytes.
+     *
+     * Values narrower than 32 bits are computed with 32-bit instructions, so they live in the low bits of the register
+     * and the bits above their width are unspecified.
+     */
+    class x86_emitter
+    {
+        u8_slice buffer;
+        size_t pos = 0;
+        bool overflow = false;
+
+        void rex(bool wide, uint8_t reg, uint8_t rm);
+        void modrm_rr(uint8_t reg, uint8_t rm);
+        void modrm_mem(uint8_t reg, gpr base, int32_t disp);
+
+    public:
+        x86_emitter(u8_slice buffer) : buffer(buffer) {}
+
+        void byte(uint8_t value)
+        {
+            if (pos < buffer.size())
+            {
+                buffer[pos++] = value;
+            }
+            else
+            {
+                overflow = true;
+            }
+        }
+
+        void imm(uint64_t value, size_t size);
+
+        void mov_rr(mc_x86_types type, gpr dst, gpr src);
+        void mov_ri(mc_x86_types type, gpr dst, uint64_t value);
+
+        /**
+         * 64-bit loads and stores of [base + disp]
+         */
+        void mov_rm(gpr dst, gpr base, int32_t disp);
+        void mov_mr(gpr base, int32_t disp, gpr src);
+
+        /**
+         * dst = dst <op> src, with `op` being the /digit of the 0x81 group (ADD = 0, SUB = 5, ...)
+         */
+        void alu_rr(uint8_t opcode, mc_x86_types type, gpr dst, gpr src);
+        void alu_ri(uint8_t digit, mc_x86_types type, gpr dst, uint64_t value);
+        void neg(mc_x86_types type, gpr reg);
+
+        /**
+         * reg = reg <shift> amount, with `digit` being the /digit of the 0xc1 group (SHL = 4, SHR = 5, SAR = 7)
+         */
+        void shift_ri(uint8_t digit, mc_x86_types type, gpr reg, uint8_t amount);
+
+        /**
+         * Zero or sign extends the low `type` bits of src into the full register dst, unlike mov_rr this always emits
+         * an instruction, even for dst == src
+         */
+        void extend(mc_x86_types type, gpr dst, gpr src, bool sign);
+
+        /**
+         * rdx:rax = rax * reg, unsigned
+         */
+        void mul(mc_x86_types type, gpr reg);
+        void imul_rr(mc_x86_types type, gpr dst, gpr src);
+        void dec_m(gpr base, int32_t disp);
+
+        /**
+         * dst = address of byte `offset` of the buffer, rip-relative so that the code can be copied anywhere
+         */
+        void lea_buffer(gpr dst, size_t offset);
+        void push(gpr reg);
+        void pop(gpr reg);
+        void ret() { byte(0xc3); }
+        void jmp(int32_t rel)
+        {
+            byte(0xe9);
+            imm(static_cast<uint32_t>(rel), 4);
+        }
+
+        /**
+         * `jnz rel8` to a label placed later with bind(); returns the position of the rel8
+         */
+        auto jnz_short() -> size_t
+        {
+            byte(0x75);
+            byte(0);
+            return pos - 1;
+        }
+
+        void bind(size_t rel8_position)
+        {
+            if (!overflow)
+            {
+                buffer[rel8_position] = static_cast<uint8_t>(pos - rel8_position - 1);
+            }
+        }
+
+        /**
+         * Pads with nops until `size() + bias` is a multiple of `alignment`
+         */
+        void align(size_t alignment, size_t bias);
+
+        [[nodiscard]] auto size() const -> size_t { return pos; }
+        [[nodiscard]] auto overflowed() const -> bool { return overflow; }
+    };
+
+    struct register_assignment;
+
+    /**
+     * What a block hands back to the dispatcher, in rax:rdx. `source` is the entry of the block that exited, which after
+     * a chain of linked jumps is not the one the dispatcher called; bit 0 of it is set when the block's entry counter
+     * ran out, in which case nothing of it has run and `next_pc` is the block's own pc. Block entries are aligned, so
+     * the bit is free.
+     */
+    struct block_exit
+    {
+        inline static constexpr uint64_t HOT = 1;
+
+        uint64_t next_pc;
+        uint64_t source;
+
+        [[nodiscard]] auto hot() const -> bool { return (source & HOT) != 0; }
+        [[nodiscard]] auto block() const -> uintptr_t { return source & ~HOT; }
+    };
+
+    using block_entry_fn = block_exit (*)();
+
+    struct encode_options
+    {
+        // counted down on every entry; when it reaches zero the block exits as hot instead of running
+        int64_t* entry_counter = nullptr;
+        uint64_t guest_pc = 0;
+    };
+
+    /**
+     * Layout of an encoded block. When the root (the next guest pc) is a constant, the block exits through a `jmp
+     * rel32` that initially jumps to the `ret` right after it; `chain_offset` is the offset of that rel32, which is 4
+     * byte aligned relative to the block start so it can be repatched atomically.
+     */
+    struct encoded_block
+    {
+        size_t size;
+        std::optional<size_t> chain_offset;
+        uint64_t next_pc;
+    };
+
+    /**
+     * Encodes an allocated block into `out`, in the order chosen by the register allocator, with its spill stores and
+     * reloads. Spill slots live in a frame reserved on entry, below the callee-saved registers the block uses, which are
+     * restored on exit as the C calling convention requires. The block returns a block_exit with the root as next pc and
+     * its own entry, the start of `out`, as source.
+     */
+    auto encode_block(const register_assignment& assignment, u8_slice out, const encode_options& options = {}) -> tl::expected<encoded_block, error>;
+
+    /**
+     * Upper bound on the bytes encode_block needs for `assignment`
+     */
+    auto max_encoded_size(const register_assignment& assignment) -> size_t;
+} // namespace sbrt::x86
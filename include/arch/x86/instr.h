@@ -27,6 +27,10 @@ namespace sbrt::x86
         SUB_ri,
         SUB_rr,
         MOV_ri,
+        SHL_ri,
+        SHR_ri,
+        SAR_ri,
+        UMULH_rr,
         MAX
     };
 
@@ -42,10 +46,14 @@ namespace sbrt::x86
             {
             case mc_x86_opcode::SUB_ri:
             case mc_x86_opcode::ADD_ri:
+            case mc_x86_opcode::SHL_ri:
+            case mc_x86_opcode::SHR_ri:
+            case mc_x86_opcode::SAR_ri:
                 sbrt_assert(submodule::MISC, index == 0);
                 return "operand";
             case mc_x86_opcode::SUB_rr:
             case mc_x86_opcode::ADD_rr:
+            case mc_x86_opcode::UMULH_rr:
                 sbrt_assert(submodule::MISC, index < 2);
                 return index == 0 ? "rhs" : "lhs";
                 break;
@@ -63,6 +71,11 @@ namespace sbrt::x86
             case mc_x86_opcode::SUB_ri:
                 sbrt_assert(submodule::MISC, index == 0);
                 return "imm";
+            case mc_x86_opcode::SHL_ri:
+            case mc_x86_opcode::SHR_ri:
+            case mc_x86_opcode::SAR_ri:
+                sbrt_assert(submodule::MISC, index == 0);
+                return "amount";
                 break;
             default:
                 sbrt_unreachable(submodule::MISC);
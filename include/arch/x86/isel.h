@@ -11,36 +11,74 @@ namespace sbrt::x86
     using namespace sbrt::isel;
 
     // clang-format off
+    // bools live in a byte and pointers are plain 64-bit values, so the encoder never sees an untyped value
     using x86_target_type_lowering = target_type_lowering<
-        mc_x86_types::NONE,
+        mc_x86_types::U8,
         mc_x86_types::U8,
         mc_x86_types::U16,
         mc_x86_types::U32,
         mc_x86_types::U64,
-        mc_x86_types::NONE
+        mc_x86_types::U64
     >;
 
+    // rule costs are the typical encoded size in bytes: op r, r is rex + opcode + modrm, op r, imm adds an imm8 or
+    // imm32, and mov r, imm is opcode + imm32 (movabs when it does not fit)
+    inline constexpr size_t COST_RR = 3;
+    inline constexpr size_t COST_RI = 4;
+    inline constexpr size_t COST_MOV_RI = 5;
+    // a shift by an imm8, plus the extension of a narrow value for right shifts
+    inline constexpr size_t COST_SHIFT = 8;
+    // the zero extended imul + shr, or the 64-bit mul with rax and rdx saved around it
+    inline constexpr size_t COST_MUL_HIGH = 19;
+
     template <ir_opcode IrOpc, mc_x86_opcode X86Opc_ri, mc_x86_opcode X86Opc_rr>
     using sel_alu = pack<
-        simple_rule<
+        with_cost<COST_RI, simple_rule<
             sel_comm<IrOpc, sel_cap<ir_opcode::IMM>, eat>,
             X86Opc_ri,
             copy_imm<0, 0>,
             copy_operand<1>,
             map_type<x86_target_type_lowering>
-        >,
-        n2n<IrOpc, X86Opc_rr, x86_target_type_lowering>
+        >>,
+        with_cost<COST_RR, n2n<IrOpc, X86Opc_rr, x86_target_type_lowering>>
     >;
 
+    // for non-commutative operations the immediate form only covers an immediate on the right
+    template <ir_opcode IrOpc, mc_x86_opcode X86Opc_ri, mc_x86_opcode X86Opc_rr>
+    using sel_alu_nc = pack<
+        with_cost<COST_RI, simple_rule<
+            sel<IrOpc, eat, sel_cap<ir_opcode::IMM>>,
+            X86Opc_ri,
+            copy_imm<1, 0>,
+            copy_operand<0>,
+            map_type<x86_target_type_lowering>
+        >>,
+        with_cost<COST_RR, n2n<IrOpc, X86Opc_rr, x86_target_type_lowering>>
+    >;
+
+    // only shifts by a constant are encodable so far, the amount goes into the imm8 of the 0xc1 group
+    template <ir_opcode IrOpc, mc_x86_opcode X86Opc>
+    using sel_shift = with_cost<COST_SHIFT, simple_rule<
+        sel<IrOpc, eat, sel_cap<ir_opcode::IMM>>,
+        X86Opc,
+        copy_imm<1, 0>,
+        copy_operand<0>,
+        map_type<x86_target_type_lowering>
+    >>;
+
     using x86_isel_info_data = pack<                                                                          //
         sel_alu<ir::ir_opcode::ADD, mc_x86_opcode::ADD_ri, mc_x86_opcode::ADD_rr>,
-        sel_alu<ir::ir_opcode::SUB, mc_x86_opcode::SUB_ri, mc_x86_opcode::SUB_rr>,
-        simple_rule<
+        sel_alu_nc<ir::ir_opcode::SUB, mc_x86_opcode::SUB_ri, mc_x86_opcode::SUB_rr>,
+        sel_shift<ir::ir_opcode::SHL, mc_x86_opcode::SHL_ri>,
+        sel_shift<ir::ir_opcode::LSHR, mc_x86_opcode::SHR_ri>,
+        sel_shift<ir::ir_opcode::ASHR, mc_x86_opcode::SAR_ri>,
+        with_cost<COST_MUL_HIGH, n2n<ir::ir_opcode::UMULH, mc_x86_opcode::UMULH_rr, x86_target_type_lowering>>,
+        with_cost<COST_MOV_RI, simple_rule<
             sel_cap<ir::ir_opcode::IMM>,
             mc_x86_opcode::MOV_ri,
             map_type<x86_target_type_lowering>,
             copy_imm<0, 0>
-        >
+        >>
     >;
     // clang-format on
 
@@ -51,6 +89,8 @@ namespace sbrt::x86
 
     struct x86_isel_pass : passes::isel::generic_isel<mc_x86_dag, x86_isel_info>
     {
+        using generic_isel::generic_isel;
+
         [[nodiscard]] auto pass_name() const -> std::string override { return "cg::x86::isel"; }
     };
 } // namespace sbrt::x86
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "arch/x86/encoder.h"
+#include "arch/x86/instr.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace sbrt::x86
+{
+    /**
+     * A store of a register into a spill slot, or a reload out of one. Slots are 8 bytes each, addressed off rsp.
+     */
+    struct spill_move
+    {
+        gpr reg;
+        bool reload;
+        uint32_t slot;
+    };
+
+    /**
+     * Result of register allocation for one block. Everything is indexed by position in `order`, the linear order the
+     * block is encoded in; operand registers and spill moves are stored flat, with a `*_base` offset table per position.
+     */
+    struct register_assignment
+    {
+        std::vector<mc_x86_dag_node*> order;
+        // register the node at each position writes its value to
+        std::vector<gpr> defs;
+        // register each operand is read from, which differs from the operand's def register once it has been reloaded
+        std::vector<gpr> operands;
+        std::vector<uint32_t> operand_base;
+        // moves to perform right before the instruction at each position, in order
+        std::vector<spill_move> moves;
+        std::vector<uint32_t> move_base;
+        uint32_t spill_slots = 0;
+        // callee-saved registers the block writes, which its prologue has to save and its epilogue restore
+        std::vector<gpr> callee_saved;
+
+        [[nodiscard]] auto operand_regs(size_t position) const -> std::span<const gpr>
+        {
+            return {operands.data() + operand_base[position], operands.data() + operand_base[position + 1]};
+        }
+
+        [[nodiscard]] auto moves_before(size_t position) const -> std::span<const spill_move>
+        {
+            return {moves.data() + move_base[position], moves.data() + move_base[position + 1]};
+        }
+    };
+
+    /**
+     * Linear scan allocation of the values in a selected dag to general purpose registers.
+     *
+     * The block is linearized in post order; instruction i reads its operands at position 2i and writes its value at
+     * 2i + 1, so a value whose last use is at i can hand its register over to the value defined there. Liveness comes
+     * from the operand edges only, the root stays live until the end of the block.
+     *
+     * When no register is free the active interval whose next use is furthest away is split: it is stored to its spill
+     * slot (once per value), and the rest of it becomes a new interval starting at its next use, which reloads it.
+     *
+     * The allocator keeps its scratch between calls, so allocating a block does not touch the heap once warmed up.
+     */
+    class linear_scan_allocator
+    {
+        struct live_interval
+        {
+            uint32_t start;
+            uint32_t end;
+            // position of the defining instruction
+            uint32_t value;
+            // first entry in `uses` that has not been given a register yet
+            uint32_t next_use;
+            gpr reg;
+        };
+
+        struct use
+        {
+            uint32_t position;
+            // index into register_assignment::operands
+            uint32_t operand;
+        };
+
+        register_assignment result;
+
+        std::vector<uint32_t> position_of;
+        std::vector<use> uses;
+        std::vector<uint32_t> use_base;
+        std::vector<uint32_t> slot_of;
+        std::vector<uint32_t> move_positions;
+
+        std::vector<live_interval> intervals;
+        // min-heap on start of the intervals that still need a register
+        std::vector<uint32_t> unhandled;
+        std::vector<uint32_t> active;
+        uint16_t free_regs = 0;
+        uint16_t used_regs = 0;
+
+        void build_uses(mc_x86_dag& dag);
+        void expire(uint32_t position);
+        void finish(live_interval& interval, uint32_t until);
+        auto next_use_after(const live_interval& interval, uint32_t position) const -> uint32_t;
+        auto split_furthest(uint32_t position) -> gpr;
+        auto take_register() -> gpr;
+
+        [[nodiscard]] auto by_start() const
+        {
+            return [this](uint32_t index) { return intervals[index].start; };
+        }
+
+    public:
+        /**
+         * Registers handed out, in order of preference; rsp and the encoder's scratch register are never used.
+         * Blocks are entered as C functions, so the callee-saved registers come last and the ones a block used are
+         * listed in register_assignment::callee_saved.
+         */
+        inline static constexpr std::array ALLOCATABLE = {
+            gpr::RAX, gpr::RCX, gpr::RDX, gpr::RSI, gpr::RDI, gpr::R8,  gpr::R9,
+            gpr::R10, gpr::RBX, gpr::RBP, gpr::R12, gpr::R13, gpr::R14, gpr::R15,
+        };
+
+        inline static constexpr std::array CALLEE_SAVED = {gpr::RBX, gpr::RBP, gpr::R12, gpr::R13, gpr::R14, gpr::R15};
+
+        /**
+         * Allocates registers for every node reachable from the root. The returned assignment is owned by the
+         * allocator and valid until the next call.
+         */
+        auto allocate(mc_x86_dag& dag) -> const register_assignment&;
+    };
+} // namespace sbrt::x86
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace sbrt
+{
+    /**
+     * Bump allocator over a list of contiguous slabs. Memory is only returned when the arena is destroyed or reset, and
+     * addresses handed out stay valid across moves of the arena itself.
+     */
+    class bump_arena
+    {
+        inline static constexpr size_t DEFAULT_SLAB_SIZE = 16 * 1024;
+
+        struct slab
+        {
+            std::unique_ptr<std::byte[]> data;
+            size_t size;
+        };
+
+        std::vector<slab> slabs;
+        size_t slab_index = 0;
+        std::byte* curr = nullptr;
+        std::byte* end = nullptr;
+        size_t slab_size;
+        size_t used = 0;
+
+        auto next_slab(size_t min_size) -> void
+        {
+            // reuse slabs that survived a reset() before growing
+            while (slab_index + 1 < slabs.size())
+            {
+                auto& next = slabs[++slab_index];
+                if (next.size >= min_size)
+                {
+                    curr = next.data.get();
+                    end = curr + next.size;
+                    return;
+                }
+            }
+
+            size_t size = std::max(slab_size, min_size);
+            slabs.push_back({std::make_unique_for_overwrite<std::byte[]>(size), size});
+            slab_index = slabs.size() - 1;
+            curr = slabs.back().data.get();
+            end = curr + size;
+        }
+
+    public:
+        bump_arena(size_t slab_size = DEFAULT_SLAB_SIZE) : slab_size(slab_size) {}
+
+        bump_arena(const bump_arena&) = delete;
+        auto operator=(const bump_arena&) -> bump_arena& = delete;
+
+        bump_arena(bump_arena&& other) noexcept
+            : slabs(std::move(other.slabs)), slab_index(other.slab_index), curr(std::exchange(other.curr, nullptr)),
+              end(std::exchange(other.end, nullptr)), slab_size(other.slab_size), used(std::exchange(other.used, 0))
+        {
+            other.slabs.clear();
+            other.slab_index = 0;
+        }
+
+        auto operator=(bump_arena&& other) noexcept -> bump_arena&
+        {
+            if (this != &other)
+            {
+                slabs = std::move(other.slabs);
+                other.slabs.clear();
+                slab_index = std::exchange(other.slab_index, 0);
+                curr = std::exchange(other.curr, nullptr);
+                end = std::exchange(other.end, nullptr);
+                slab_size = other.slab_size;
+                used = std::exchange(other.used, 0);
+            }
+            return *this;
+        }
+
+        [[nodiscard]] auto allocate(size_t size, size_t align) -> void*
+        {
+            auto addr = reinterpret_cast<std::uintptr_t>(curr);
+            auto aligned = (addr + align - 1) & ~(std::uintptr_t)(align - 1);
+
+            if (curr == nullptr || aligned + size > reinterpret_cast<std::uintptr_t>(end))
+            {
+                next_slab(size + align);
+                addr = reinterpret_cast<std::uintptr_t>(curr);
+                aligned = (addr + align - 1) & ~(std::uintptr_t)(align - 1);
+            }
+
+            used += aligned + size - addr;
+            curr = reinterpret_cast<std::byte*>(aligned + size);
+            return reinterpret_cast<void*>(aligned);
+        }
+
+        template <typename T, typename... Args>
+        [[nodiscard]] auto create(Args&&... args) -> T*
+        {
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        /**
+         * Gives back the most recent allocation if `ptr` is the start of it, no-op otherwise
+         */
+        void rollback(void* ptr, size_t size)
+        {
+            if (static_cast<std::byte*>(ptr) + size == curr)
+            {
+                used -= size;
+                curr = static_cast<std::byte*>(ptr);
+            }
+        }
+
+        /**
+         * Invalidates every allocation, but keeps the slabs around for reuse
+         */
+        void reset()
+        {
+            slab_index = 0;
+            used = 0;
+            curr = slabs.empty() ? nullptr : slabs.front().data.get();
+            end = slabs.empty() ? nullptr : curr + slabs.front().size;
+        }
+
+        [[nodiscard]] auto bytes_used() const -> size_t { return used; }
+        [[nodiscard]] auto bytes_reserved() const -> size_t
+        {
+            size_t total = 0;
+            for (const auto& entry : slabs)
+            {
+                total += entry.size;
+            }
+            return total;
+        }
+    };
+} // namespace sbrt
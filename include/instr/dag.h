@@ -1,13 +1,22 @@
 #pragma once
 
+#include "arena.h"
+#include "common.h"
 #include "dag_writer.h"
+#include "instr/dense_dag.h"
+#include "small_vector.h"
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <memory>
-#include <queue>
 #include <span>
 #include <string>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace sbrt
@@ -25,6 +34,8 @@ namespace sbrt
     private:
         dag_type* owner_dag;
         size_t id;
+        // one entry per operand or chain edge pointing at this node, kept up to date by the owning dag
+        small_vector<ThisType*, 2> users;
 
         constexpr void do_cons() {}
 
@@ -48,22 +59,40 @@ namespace sbrt
         constexpr dag_node(dag_type* dag, size_t node_id, ThisType* chain, OpcodeType opcode, TypeType type, Ts&&... args)
             : owner_dag(dag), id(node_id), chain(chain), opcode(opcode), type(type)
         {
-            size_t op_count = ((std::same_as<Ts, ThisType*> ? 1 : 0) + ... + 0);
+            size_t op_count = ((std::same_as<std::decay_t<Ts>, ThisType*> ? 1 : 0) + ... + 0);
             operands.reserve(op_count);
             imm.reserve(sizeof...(Ts) - op_count);
             do_cons(std::forward<Ts>(args)...);
         }
 
-        std::vector<ThisType*> operands;
+        // most nodes are unary/binary with at most one immediate, so keep those inline in the node
+        small_vector<ThisType*, 3> operands;
         ThisType* chain;
-        std::vector<ImmType> imm;
+        small_vector<ImmType, 2> imm;
         OpcodeType opcode;
         TypeType type{};
 
         [[nodiscard]] constexpr auto get_dag() const -> auto* { return owner_dag; }
         [[nodiscard]] constexpr auto get_id() const -> size_t { return id; }
+        [[nodiscard]] constexpr auto get_users() const -> std::span<ThisType* const> { return {users.data(), users.size()}; }
+        [[nodiscard]] constexpr auto use_count() const -> size_t { return users.size(); }
+        [[nodiscard]] constexpr auto has_one_use() const -> bool { return users.size() == 1; }
     };
 
+    namespace detail
+    {
+        template <typename T>
+        constexpr auto hash_bits(const T& value) -> size_t
+        {
+            static_assert(std::has_unique_object_representations_v<T> && sizeof(T) <= sizeof(uint64_t), "value cannot be hashed by its bits");
+            uint64_t bits = 0;
+            std::memcpy(&bits, &value, sizeof(T));
+            return std::hash<uint64_t>{}(bits);
+        }
+
+        constexpr auto hash_combine(size_t seed, size_t value) -> size_t { return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)); }
+    } // namespace detail
+
     template <typename OpcodeType, typename TypeType, typename ImmType, typename ThisType, typename NodeType>
     class dag
     {
@@ -72,55 +101,619 @@ namespace sbrt
         using opcode_type = OpcodeType;
         using type_type = TypeType;
 
+        /**
+         * Decides whether a node may be merged with an identical one, used to keep side-effecting nodes distinct
+         */
+        using cse_filter_t = bool (*)(const node_type*);
+
+        static auto cse_chainless(const node_type* node) -> bool { return node->chain == nullptr; }
+
     private:
-        std::vector<std::unique_ptr<node_type>> nodes;
-        node_type* root_ptr;
+        // nodes are bump allocated out of `arena` and owned by the dag, `nodes` is only an id -> node index
+        bump_arena arena;
+        std::vector<node_type*> nodes;
+        node_type* root_ptr = nullptr;
+
+        // traversal scratch, reused across walks so that they do not allocate once warmed up. A node is visited in
+        // the current walk iff visit_epoch[id] == epoch, so starting a walk does not need to clear anything.
+        std::vector<uint32_t> visit_epoch;
+        uint32_t epoch = 0;
+        std::vector<node_type*> walk_order;
+        std::vector<std::pair<node_type*, size_t>> walk_stack;
+
+        void begin_walk()
+        {
+            if (visit_epoch.size() < nodes.size())
+            {
+                visit_epoch.resize(nodes.capacity(), 0);
+            }
+
+            if (++epoch == 0)
+            {
+                std::ranges::fill(visit_epoch, 0);
+                epoch = 1;
+            }
+        }
+
+        /**
+         * Returns true if the node was not visited yet in the current walk
+         */
+        auto mark_visited(node_type* node) -> bool
+        {
+            size_t id = node->get_id();
+            if (id >= visit_epoch.size())
+            {
+                // created during the walk
+                visit_epoch.resize(nodes.capacity(), 0);
+            }
+
+            if (visit_epoch[id] == epoch)
+            {
+                return false;
+            }
+
+            visit_epoch[id] = epoch;
+            return true;
+        }
+
+        // open addressing table of hash-consed nodes, empty unless cse is enabled
+        std::vector<node_type*> cse_table;
+        size_t cse_size = 0;
+        cse_filter_t cse_filter = nullptr;
+
+        static auto node_hash(const node_type* node) -> size_t
+        {
+            size_t hash = detail::hash_bits(node->opcode);
+            hash = detail::hash_combine(hash, detail::hash_bits(node->type));
+            hash = detail::hash_combine(hash, detail::hash_bits(node->chain));
+            for (const auto* operand : node->operands)
+            {
+                hash = detail::hash_combine(hash, detail::hash_bits(operand));
+            }
+            for (const auto& value : node->imm)
+            {
+                hash = detail::hash_combine(hash, std::hash<ImmType>{}(value));
+            }
+            return hash;
+        }
+
+        static auto node_equal(const node_type* lhs, const node_type* rhs) -> bool
+        {
+            return lhs->opcode == rhs->opcode && lhs->type == rhs->type && lhs->chain == rhs->chain &&
+                   std::ranges::equal(lhs->operands, rhs->operands) && std::ranges::equal(lhs->imm, rhs->imm);
+        }
+
+        /**
+         * Returns the table slot holding a node equal to `node`, or the empty slot where it would go
+         */
+        auto cse_find(const node_type* node) -> node_type*&
+        {
+            size_t mask = cse_table.size() - 1;
+            for (size_t slot = node_hash(node) & mask;; slot = (slot + 1) & mask)
+            {
+                if (cse_table[slot] == nullptr || node_equal(cse_table[slot], node))
+                {
+                    return cse_table[slot];
+                }
+            }
+        }
+
+        void cse_rehash(size_t capacity)
+        {
+            cse_table.assign(capacity, nullptr);
+            cse_size = 0;
+            for (auto* node : nodes)
+            {
+                if (cse_filter(node))
+                {
+                    auto& slot = cse_find(node);
+                    if (slot == nullptr)
+                    {
+                        slot = node;
+                        cse_size++;
+                    }
+                }
+            }
+        }
+
+        /**
+         * Removes `node` itself (not merely an equal node) from the table, using backward shift deletion
+         */
+        void cse_erase(node_type* node)
+        {
+            if (cse_filter == nullptr || !cse_filter(node))
+            {
+                return;
+            }
+
+            auto& found = cse_find(node);
+            if (found != node)
+            {
+                return;
+            }
+
+            size_t mask = cse_table.size() - 1;
+            size_t hole = &found - cse_table.data();
+            for (size_t slot = (hole + 1) & mask; cse_table[slot] != nullptr; slot = (slot + 1) & mask)
+            {
+                size_t home = node_hash(cse_table[slot]) & mask;
+                // move the entry back into the hole unless its home lies cyclically in (hole, slot]
+                if (((slot - home) & mask) >= ((slot - hole) & mask))
+                {
+                    cse_table[hole] = cse_table[slot];
+                    hole = slot;
+                }
+            }
+            cse_table[hole] = nullptr;
+            cse_size--;
+        }
+
+        void add_use(node_type* used, node_type* user)
+        {
+            if (used != nullptr)
+            {
+                used->users.push_back(user);
+            }
+        }
+
+        void remove_use(node_type* used, node_type* user)
+        {
+            if (used != nullptr)
+            {
+                auto it = std::ranges::find(used->users, user);
+                sbrt_assert(submodule::MISC, it != used->users.end());
+                used->users.erase(it);
+            }
+        }
+
+        void register_uses(node_type* node)
+        {
+            add_use(node->chain, node);
+            for (auto* operand : node->operands)
+            {
+                add_use(operand, node);
+            }
+        }
+
+        auto cse_insert(node_type* node) -> node_type*
+        {
+            if ((cse_size + 1) * 2 > cse_table.size())
+            {
+                cse_rehash(std::max<size_t>(64, cse_table.size() * 2));
+            }
+
+            auto& slot = cse_find(node);
+            if (slot != nullptr)
+            {
+                return slot;
+            }
+
+            slot = node;
+            cse_size++;
+            return node;
+        }
+
+        void destroy_nodes()
+        {
+            if constexpr (!std::is_trivially_destructible_v<node_type>)
+            {
+                for (auto* node : nodes)
+                {
+                    std::destroy_at(node);
+                }
+            }
+            nodes.clear();
+        }
+
+        void rebind_nodes()
+        {
+            for (auto* node : nodes)
+            {
+                node->owner_dag = (ThisType*)this;
+            }
+        }
 
     public:
+        dag() = default;
+        dag(const dag&) = delete;
+        auto operator=(const dag&) -> dag& = delete;
+
+        dag(dag&& other) noexcept
+            : arena(std::move(other.arena)), nodes(std::exchange(other.nodes, {})), root_ptr(std::exchange(other.root_ptr, nullptr)),
+              visit_epoch(std::exchange(other.visit_epoch, {})), epoch(std::exchange(other.epoch, 0)), walk_order(std::exchange(other.walk_order, {})),
+              walk_stack(std::exchange(other.walk_stack, {})), cse_table(std::exchange(other.cse_table, {})), cse_size(std::exchange(other.cse_size, 0)),
+              cse_filter(std::exchange(other.cse_filter, nullptr))
+        {
+            rebind_nodes();
+        }
+
+        auto operator=(dag&& other) noexcept -> dag&
+        {
+            if (this != &other)
+            {
+                destroy_nodes();
+                arena = std::move(other.arena);
+                nodes = std::exchange(other.nodes, {});
+                root_ptr = std::exchange(other.root_ptr, nullptr);
+                cse_table = std::exchange(other.cse_table, {});
+                cse_size = std::exchange(other.cse_size, 0);
+                cse_filter = std::exchange(other.cse_filter, nullptr);
+                visit_epoch = std::exchange(other.visit_epoch, {});
+                epoch = std::exchange(other.epoch, 0);
+                walk_order = std::exchange(other.walk_order, {});
+                walk_stack = std::exchange(other.walk_stack, {});
+                rebind_nodes();
+            }
+            return *this;
+        }
+
+        ~dag() { destroy_nodes(); }
+
+        /**
+         * Creates a node. With cse enabled, a node identical to an existing one (same opcode, type, chain, operands
+         * and immediates) that passes the filter is not created, and the existing node is returned instead.
+         */
         template <typename... Ts>
         constexpr auto create(node_type* chain, OpcodeType opcode, TypeType type, Ts&&... args) -> node_type*
         {
-            return nodes.emplace_back(std::make_unique<node_type>((ThisType*)this, nodes.size(), chain, opcode, type, std::forward<Ts>(args)...))
-                .get();
+            auto* node = arena.create<node_type>((ThisType*)this, nodes.size(), chain, opcode, type, std::forward<Ts>(args)...);
+
+            if (cse_filter != nullptr && cse_filter(node))
+            {
+                auto* existing = cse_insert(node);
+                if (existing != node)
+                {
+                    std::destroy_at(node);
+                    arena.rollback(node, sizeof(node_type));
+                    return existing;
+                }
+            }
+
+            register_uses(node);
+            return nodes.emplace_back(node);
+        }
+
+        /**
+         * Creates a node that is never merged with another one, regardless of the cse setting
+         */
+        template <typename... Ts>
+        constexpr auto create_unique(node_type* chain, OpcodeType opcode, TypeType type, Ts&&... args) -> node_type*
+        {
+            auto* node = arena.create<node_type>((ThisType*)this, nodes.size(), chain, opcode, type, std::forward<Ts>(args)...);
+            register_uses(node);
+            return nodes.emplace_back(node);
+        }
+
+        /**
+         * Turns on hash-consing in create(); by default only nodes without a chain are merged
+         */
+        void enable_cse(cse_filter_t filter = cse_chainless)
+        {
+            cse_filter = filter;
+            cse_rehash(std::max<size_t>(64, std::bit_ceil(nodes.size() * 2)));
         }
 
-        auto max_node_id() -> size_t { return nodes.size(); }
+        void disable_cse()
+        {
+            cse_filter = nullptr;
+            cse_table = {};
+            cse_size = 0;
+        }
+
+        [[nodiscard]] auto cse_enabled() const -> bool { return cse_filter != nullptr; }
+
+        /**
+         * Rebuilds the cse table; needed after nodes were mutated in place while cse is enabled
+         */
+        void rebuild_cse()
+        {
+            if (cse_enabled())
+            {
+                cse_rehash(cse_table.size());
+            }
+        }
+
+        /**
+         * Edge mutators. These keep use lists (and the cse table) consistent, and should be preferred over writing to
+         * `operands`/`chain` directly; code that does write directly must call recompute_uses() afterwards.
+         */
+        void add_operand(node_type* node, node_type* operand)
+        {
+            cse_erase(node);
+            node->operands.push_back(operand);
+            add_use(operand, node);
+            rehash_node(node);
+        }
+
+        void set_operand(node_type* node, size_t index, node_type* operand)
+        {
+            cse_erase(node);
+            remove_use(node->operands[index], node);
+            node->operands[index] = operand;
+            add_use(operand, node);
+            rehash_node(node);
+        }
+
+        void set_chain(node_type* node, node_type* chain)
+        {
+            cse_erase(node);
+            remove_use(node->chain, node);
+            node->chain = chain;
+            add_use(chain, node);
+            rehash_node(node);
+        }
+
+        void clear_operands(node_type* node)
+        {
+            cse_erase(node);
+            for (auto* operand : node->operands)
+            {
+                remove_use(operand, node);
+            }
+            node->operands.clear();
+            rehash_node(node);
+        }
+
+        /**
+         * Must bracket in-place edits of a node's opcode/type/imm while cse is enabled
+         */
+        void unhash_node(node_type* node) { cse_erase(node); }
+        void rehash_node(node_type* node)
+        {
+            if (cse_filter != nullptr && cse_filter(node))
+            {
+                cse_insert(node);
+            }
+        }
+
+        /**
+         * Rewrites every operand and chain edge pointing at `from` to point at `to` instead; the root moves as well
+         */
+        void replace_all_uses_with(node_type* from, node_type* to)
+        {
+            if (from == to)
+            {
+                return;
+            }
+
+            auto old_users = std::move(from->users);
+            from->users.clear();
+
+            for (auto* user : old_users)
+            {
+                bool is_use = user->chain == from || std::ranges::find(user->operands, from) != user->operands.end();
+                if (!is_use)
+                {
+                    // duplicate entry for a user with several edges to `from`, already rewritten
+                    continue;
+                }
+
+                cse_erase(user);
+                if (user->chain == from)
+                {
+                    user->chain = to;
+                    add_use(to, user);
+                }
+
+                for (auto*& operand : user->operands)
+                {
+                    if (operand == from)
+                    {
+                        operand = to;
+                        add_use(to, user);
+                    }
+                }
+                rehash_node(user);
+            }
+
+            if (root_ptr == from)
+            {
+                root_ptr = to;
+            }
+        }
+
+        /**
+         * Rebuilds every use list from the operand and chain edges
+         */
+        void recompute_uses()
+        {
+            for (auto* node : nodes)
+            {
+                node->users.clear();
+            }
+
+            for (auto* node : nodes)
+            {
+                register_uses(node);
+            }
+        }
+
+        /**
+         * Destroys every node that is not reachable from the root, and renumbers the survivors with dense ids (keeping
+         * their relative order). Node pointers to live nodes stay valid, but ids do not.
+         */
+        void erase_unreachable()
+        {
+            if (root_ptr == nullptr)
+            {
+                return;
+            }
+
+            // marks the live set with the current epoch
+            post_order(root_ptr);
+            auto is_live = [this](node_type* node) { return visit_epoch[node->get_id()] == epoch; };
+
+            // drop edges from dead users first, while every node still has its old id
+            for (auto* node : nodes)
+            {
+                if (is_live(node))
+                {
+                    auto dead = std::remove_if(node->users.begin(), node->users.end(), [&](node_type* user) { return !is_live(user); });
+                    while (node->users.end() != dead)
+                    {
+                        node->users.pop_back();
+                    }
+                }
+            }
+
+            size_t live_count = 0;
+            for (auto* node : nodes)
+            {
+                if (is_live(node))
+                {
+                    node->id = live_count;
+                    nodes[live_count++] = node;
+                }
+                else
+                {
+                    std::destroy_at(node);
+                }
+            }
+            nodes.resize(live_count);
+
+            // ids changed, so retire the stamps of this walk before anyone looks at them again
+            begin_walk();
+            rebuild_cse();
+        }
+
+        /**
+         * Pre-sizes the id index for `count` nodes, so bulk creation (such as isel) does not regrow it
+         */
+        void reserve(size_t count) { nodes.reserve(count); }
+
+        [[nodiscard]] auto allocated_bytes() const -> size_t
+        {
+            return arena.bytes_used() + (nodes.capacity() + cse_table.capacity()) * sizeof(node_type*);
+        }
+
+        auto max_node_id() const -> size_t { return nodes.size(); }
 
         auto root() -> node_type* { return root_ptr; }
+        auto root() const -> const node_type* { return root_ptr; }
         auto root(node_type* node)
         {
             assert(node->owner_dag == (ThisType*)this);
             root_ptr = node;
         }
 
-        void visit_nodes(auto callback)
+        /**
+         * Calls `callback` on every node reachable from `start` after all of its operands and its chain, i.e. in an
+         * order where a node is only seen once everything it depends on has been seen.
+         */
+        void visit_post_order(node_type* start, auto callback)
         {
-            std::queue<node_type*> queue;
-            queue.push(root());
-            std::vector<bool> visited(max_node_id());
+            for (auto* node : post_order(start))
+            {
+                callback(node);
+            }
+        }
+
+        void visit_post_order(auto callback) { visit_post_order(root(), callback); }
 
-            while (!queue.empty())
+        /**
+         * Reverse post order: users before the values they consume, starting with `start`
+         */
+        void visit_reverse_post_order(node_type* start, auto callback)
+        {
+            auto order = post_order(start);
+            for (auto it = order.rbegin(); it != order.rend(); ++it)
             {
-                auto node = queue.front();
-                queue.pop();
+                callback(*it);
+            }
+        }
+
+        void visit_reverse_post_order(auto callback) { visit_reverse_post_order(root(), callback); }
 
-                if (visited[node->get_id()])
+        /**
+         * Breadth first from `start`, each reachable node is visited exactly once
+         */
+        void visit_bfs(node_type* start, auto callback)
+        {
+            walk_order.clear();
+            if (start == nullptr)
+            {
+                return;
+            }
+
+            begin_walk();
+            mark_visited(start);
+            walk_order.push_back(start);
+
+            // walk_order doubles as the queue, everything before `head` has been visited already
+            for (size_t head = 0; head < walk_order.size(); head++)
+            {
+                auto* node = walk_order[head];
+                callback(node);
+
+                if (node->chain != nullptr && mark_visited(node->chain))
                 {
-                    continue;
+                    walk_order.push_back(node->chain);
                 }
 
-                callback(node);
-                visited[node->get_id()] = true;
                 for (auto* operand : node->operands)
                 {
-                    queue.push(operand);
+                    if (mark_visited(operand))
+                    {
+                        walk_order.push_back(operand);
+                    }
+                }
+            }
+        }
+
+        void visit_bfs(auto callback) { visit_bfs(root(), callback); }
+
+        /**
+         * Post order of the nodes reachable from `start`. The span points into scratch storage owned by the dag, and
+         * is only valid until the next traversal.
+         */
+        auto post_order(node_type* start) -> std::span<node_type* const>
+        {
+            walk_order.clear();
+            if (start == nullptr)
+            {
+                return {};
+            }
+
+            begin_walk();
+            walk_stack.clear();
+            mark_visited(start);
+            walk_stack.push_back({start, 0});
+
+            while (!walk_stack.empty())
+            {
+                auto& [node, next] = walk_stack.back();
+
+                // child 0 is the chain, the rest are operands
+                node_type* child = nullptr;
+                while (child == nullptr && next <= node->operands.size())
+                {
+                    auto* candidate = next == 0 ? node->chain : node->operands[next - 1];
+                    next++;
+                    if (candidate != nullptr && mark_visited(candidate))
+                    {
+                        child = candidate;
+                    }
+                }
+
+                if (child != nullptr)
+                {
+                    walk_stack.push_back({child, 0});
+                }
+                else
+                {
+                    walk_order.push_back(node);
+                    walk_stack.pop_back();
                 }
             }
+
+            return walk_order;
         }
 
+        auto post_order() -> std::span<node_type* const> { return post_order(root()); }
+
         auto emit_dot(auto& output)
         {
-            visit_nodes([&output](node_type* node) {
+            visit_bfs([&output](node_type* node) {
                 output.emit_node(node, "");
 
                 if (node->chain != nullptr)
@@ -137,10 +730,10 @@ namespace sbrt
             output.done(root());
         }
 
-        constexpr auto get_nodes() -> std::span<std::unique_ptr<node_type>> { return nodes; }
-        constexpr auto get_nodes() const -> std::span<const std::unique_ptr<node_type>> { return nodes; }
-        auto operator[](size_t node_id) -> node_type* { return nodes[node_id].get(); }
-        auto operator[](size_t node_id) const -> const node_type* { return nodes[node_id].get(); }
+        constexpr auto get_nodes() -> std::span<node_type* const> { return nodes; }
+        constexpr auto get_nodes() const -> std::span<const node_type* const> { return {nodes.data(), nodes.size()}; }
+        auto operator[](size_t node_id) -> node_type* { return nodes[node_id]; }
+        auto operator[](size_t node_id) const -> const node_type* { return nodes[node_id]; }
     };
 } // namespace sbrt
 
@@ -154,4 +747,6 @@ namespace sbrt
     struct name##_dag : dag<name##_opcode, name##_types, name##_imm_type, name##_dag, name##_dag_node>                                               \
     {                                                                                                                                                \
         using dag<name##_opcode, name##_types, name##_imm_type, name##_dag, name##_dag_node>::dag;                                                   \
-    };
+    };                                                                                                                                               \
+                                                                                                                                                     \
+    using name##_dense_dag = dense_dag<name##_opcode, name##_types, name##_imm_type>;
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "common.h"
+#include "small_vector.h"
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+namespace sbrt
+{
+    /**
+     * Structure-of-arrays storage for a dag. Every per-node field lives in its own dense array indexed by node id, and
+     * nodes refer to each other by 32-bit index instead of by pointer, so sweeps over a single field (opcode/type) stay
+     * linear and only touch the memory they actually need.
+     */
+    template <typename OpcodeType, typename TypeType, typename ImmType>
+    class dense_dag
+    {
+    public:
+        using index_type = uint32_t;
+        using opcode_type = OpcodeType;
+        using type_type = TypeType;
+        using imm_type = ImmType;
+
+        inline static constexpr index_type NO_NODE = std::numeric_limits<index_type>::max();
+
+    private:
+        std::vector<OpcodeType> opcodes;
+        std::vector<TypeType> types;
+        std::vector<index_type> chains;
+        // node i owns operand_pool[operand_begin[i], operand_begin[i + 1]), same for immediates
+        std::vector<index_type> operand_begin{0};
+        std::vector<index_type> imm_begin{0};
+        std::vector<index_type> operand_pool;
+        std::vector<ImmType> imm_pool;
+        index_type root_index = NO_NODE;
+
+        auto append(index_type chain, OpcodeType opcode, TypeType type, auto&& operands, auto&& imm) -> index_type
+        {
+            auto index = static_cast<index_type>(opcodes.size());
+            opcodes.push_back(opcode);
+            types.push_back(type);
+            chains.push_back(chain);
+            operand_pool.insert(operand_pool.end(), operands.begin(), operands.end());
+            imm_pool.insert(imm_pool.end(), imm.begin(), imm.end());
+            operand_begin.push_back(static_cast<index_type>(operand_pool.size()));
+            imm_begin.push_back(static_cast<index_type>(imm_pool.size()));
+            return index;
+        }
+
+    public:
+        void reserve(size_t node_count, size_t operand_count, size_t imm_count)
+        {
+            opcodes.reserve(node_count);
+            types.reserve(node_count);
+            chains.reserve(node_count);
+            operand_begin.reserve(node_count + 1);
+            imm_begin.reserve(node_count + 1);
+            operand_pool.reserve(operand_count);
+            imm_pool.reserve(imm_count);
+        }
+
+        /**
+         * Appends a node; the chain and operands must refer to nodes that already exist
+         */
+        auto create(index_type chain, OpcodeType opcode, TypeType type, std::span<const index_type> operands = {}, std::span<const ImmType> imm = {})
+            -> index_type
+        {
+            sbrt_assert(submodule::MISC, chain == NO_NODE || chain < size());
+            for (auto operand : operands)
+            {
+                sbrt_assert(submodule::MISC, operand < size());
+            }
+
+            return append(chain, opcode, type, operands, imm);
+        }
+
+        [[nodiscard]] auto size() const -> size_t { return opcodes.size(); }
+        [[nodiscard]] auto max_node_id() const -> size_t { return opcodes.size(); }
+
+        [[nodiscard]] auto root() const -> index_type { return root_index; }
+        void root(index_type index)
+        {
+            sbrt_assert(submodule::MISC, index < size());
+            root_index = index;
+        }
+
+        [[nodiscard]] auto opcode(index_type index) const -> OpcodeType { return opcodes[index]; }
+        [[nodiscard]] auto type(index_type index) const -> TypeType { return types[index]; }
+        [[nodiscard]] auto chain(index_type index) const -> index_type { return chains[index]; }
+
+        [[nodiscard]] auto operands(index_type index) const -> std::span<const index_type>
+        {
+            return std::span(operand_pool).subspan(operand_begin[index], operand_begin[index + 1] - operand_begin[index]);
+        }
+
+        [[nodiscard]] auto imm(index_type index) const -> std::span<const ImmType>
+        {
+            return std::span(imm_pool).subspan(imm_begin[index], imm_begin[index + 1] - imm_begin[index]);
+        }
+
+        // whole-column access, for passes that only care about a single field
+        [[nodiscard]] auto get_opcodes() -> std::span<OpcodeType> { return opcodes; }
+        [[nodiscard]] auto get_opcodes() const -> std::span<const OpcodeType> { return opcodes; }
+        [[nodiscard]] auto get_types() -> std::span<TypeType> { return types; }
+        [[nodiscard]] auto get_types() const -> std::span<const TypeType> { return types; }
+        [[nodiscard]] auto get_chains() const -> std::span<const index_type> { return chains; }
+
+        [[nodiscard]] auto allocated_bytes() const -> size_t
+        {
+            return opcodes.capacity() * sizeof(OpcodeType) + types.capacity() * sizeof(TypeType) +
+                   (chains.capacity() + operand_begin.capacity() + imm_begin.capacity() + operand_pool.capacity()) * sizeof(index_type) +
+                   imm_pool.capacity() * sizeof(ImmType);
+        }
+
+        /**
+         * Builds the dense form of a pointer-based dag; node ids are preserved
+         */
+        template <typename Dag>
+        static auto from(const Dag& dag) -> dense_dag
+        {
+            dense_dag result;
+            size_t operand_count = 0;
+            size_t imm_count = 0;
+            for (const auto* node : dag.get_nodes())
+            {
+                operand_count += node->operands.size();
+                imm_count += node->imm.size();
+            }
+            result.reserve(dag.max_node_id(), operand_count, imm_count);
+
+            small_vector<index_type, 3> operands;
+            for (const auto* node : dag.get_nodes())
+            {
+                operands.clear();
+                for (const auto* operand : node->operands)
+                {
+                    operands.push_back(static_cast<index_type>(operand->get_id()));
+                }
+
+                result.append(
+                    node->chain == nullptr ? NO_NODE : static_cast<index_type>(node->chain->get_id()), node->opcode, node->type, operands, node->imm
+                );
+            }
+
+            if (dag.root() != nullptr)
+            {
+                result.root_index = static_cast<index_type>(dag.root()->get_id());
+            }
+
+            return result;
+        }
+
+        /**
+         * Rebuilds the pointer-based form, with the same node ids
+         */
+        template <typename Dag>
+        auto to() const -> Dag
+        {
+            Dag result;
+            result.reserve(size());
+            for (size_t i = 0; i < size(); i++)
+            {
+                result.create(nullptr, opcodes[i], types[i]);
+            }
+
+            for (index_type i = 0; i < size(); i++)
+            {
+                auto* node = result[i];
+                node->chain = chains[i] == NO_NODE ? nullptr : result[chains[i]];
+                for (auto operand : operands(i))
+                {
+                    node->operands.push_back(result[operand]);
+                }
+                for (const auto& value : imm(i))
+                {
+                    node->imm.push_back(value);
+                }
+            }
+
+            result.recompute_uses();
+            if (root_index != NO_NODE)
+            {
+                result.root(result[root_index]);
+            }
+
+            return result;
+        }
+    };
+} // namespace sbrt
@@ -40,11 +40,34 @@ namespace sbrt::ir
         constexpr ir_types(primitives primitive) : data(primitive) {}
         constexpr ir_types() : data(NONE) {}
 
+        constexpr auto operator==(const ir_types& other) const -> bool = default;
+
         [[nodiscard]] constexpr auto is_primitive() const -> bool { return data < PRIMITIVE_MAX; }
         [[nodiscard]] constexpr auto primitive() const -> primitives { return static_cast<primitives>(data); }
         [[nodiscard]] constexpr auto type_desc() const -> void* { return as_vptr(data); }
         [[nodiscard]] constexpr auto is_ptr() const -> bool { return false; }
-        auto read_uint(sbrt::byte_reader& reader) const -> uint64_t
+
+        /**
+         * Width of the integer types in bits, 0 for everything else
+         */
+        [[nodiscard]] constexpr auto bit_width() const -> size_t
+        {
+            switch (data)
+            {
+            case U8:
+                return 8;
+            case U16:
+                return 16;
+            case U32:
+                return 32;
+            case U64:
+                return 64;
+            default:
+                return 0;
+            }
+        }
+        template <typename Reader>
+        auto read_uint(Reader& reader) const -> uint64_t
         {
             switch (data)
             {
@@ -72,6 +95,12 @@ namespace sbrt::ir
         MUL,
         UDIV,
         SDIV,
+        // shifts by operand 1, which is below the bit width of the type
+        SHL,
+        LSHR,
+        ASHR,
+        // high half of the double-width unsigned product
+        UMULH,
         MAX
     };
 
@@ -95,8 +124,14 @@ namespace sbrt::ir
             case ir_opcode::MUL:
             case ir_opcode::UDIV:
             case ir_opcode::SDIV:
+            case ir_opcode::UMULH:
                 sbrt_assert(submodule::MISC, index < 2);
                 return index == 0 ? "rhs" : "lhs";
+            case ir_opcode::SHL:
+            case ir_opcode::LSHR:
+            case ir_opcode::ASHR:
+                sbrt_assert(submodule::MISC, index < 2);
+                return index == 0 ? "value" : "amount";
             }
         }
 
@@ -110,6 +145,10 @@ namespace sbrt::ir
             case ir_opcode::MUL:
             case ir_opcode::UDIV:
             case ir_opcode::SDIV:
+            case ir_opcode::SHL:
+            case ir_opcode::LSHR:
+            case ir_opcode::ASHR:
+            case ir_opcode::UMULH:
             case ir_opcode::MAX:
                 sbrt_unreachable(submodule::MISC);
             case ir_opcode::IMM:
@@ -1,8 +1,11 @@
 #pragma once
 
 #include "cast.h"
+#include <algorithm>
 #include <bit>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <span>
 #include <stdexcept>
@@ -12,6 +15,7 @@
 namespace sbrt
 {
     using u8_slice = std::span<uint8_t>;
+    using u8_view = std::span<const uint8_t>;
     using u8_buf = std::vector<uint8_t>;
 
     class io_error : std::runtime_error
@@ -35,6 +39,26 @@ namespace sbrt
             auto off() const -> size_t { return input.gcount(); }
             auto has() -> bool { return !input.eof(); }
         };
+
+        /**
+         * A whole file mapped read-only
+         */
+        class mapped_file
+        {
+            const uint8_t* data = nullptr;
+            size_t size = 0;
+
+        public:
+            mapped_file() = default;
+            explicit mapped_file(const std::string& path);
+            mapped_file(const mapped_file&) = delete;
+            mapped_file(mapped_file&& other) noexcept;
+            auto operator=(const mapped_file&) -> mapped_file& = delete;
+            auto operator=(mapped_file&& other) noexcept -> mapped_file&;
+            ~mapped_file();
+
+            [[nodiscard]] auto bytes() const -> u8_view { return {data, size}; }
+        };
     } // namespace detail
 
     template <typename T>
@@ -141,4 +165,103 @@ namespace sbrt
 
         void skip(size_t size) { impl.skip(size); }
     };
+
+    /**
+     * byte_reader over a memory-mapped file, or over bytes already in memory. Reads are bounds-checked loads from the
+     * mapping rather than stream calls, and read(size_t) returns a read-only view into the mapping instead of a copy;
+     * views stay valid for as long as the reader does.
+     */
+    class mapped_byte_reader
+    {
+        detail::mapped_file file;
+        u8_view data;
+        size_t pos = 0;
+
+        inline static constexpr uint8_t LEB_MASK = 0x7f;
+        inline static constexpr uint8_t MAX_LEN = 63;
+        inline static constexpr uint8_t CONT_MAX = 128;
+
+        template <typename T>
+            requires std::is_unsigned_v<T>
+        auto read_native_uint() -> T
+        {
+            if (remaining() < sizeof(T))
+            {
+                throw io_error("error reading value: unexpected EOB");
+            }
+
+            T result;
+            std::memcpy(&result, data.data() + pos, sizeof(T));
+            pos += sizeof(T);
+            return result;
+        }
+
+    public:
+        explicit mapped_byte_reader(const std::string& path) : file(path), data(file.bytes()) {}
+        explicit mapped_byte_reader(u8_view bytes) : data(bytes) {}
+
+#define MAKE_READ_U(n)                                                                                                                               \
+    auto read_u##n() -> uint##n##_t { return read_native_uint<uint##n##_t>(); }
+        MAKE_READ_U(8);
+        MAKE_READ_U(16);
+        MAKE_READ_U(32);
+        MAKE_READ_U(64);
+#undef MAKE_READ_U
+
+        auto read_uleb() -> uint64_t
+        {
+            uint64_t res = 0;
+            unsigned shift = 0;
+            uint8_t curr = 0;
+            do
+            {
+                if (pos == data.size())
+                {
+                    throw io_error("failed to read uleb128: unexpected EOB");
+                }
+
+                curr = data[pos++];
+                uint64_t val = curr & LEB_MASK;
+
+                if (shift >= MAX_LEN && ((shift == MAX_LEN && (val << shift >> shift) != val) || (shift > MAX_LEN && val != 0)))
+                {
+                    throw io_error("failed to read uleb128: too big");
+                }
+
+                res |= val << (shift & MAX_LEN);
+                shift += 7;
+            } while (curr >= CONT_MAX);
+
+            return res;
+        }
+
+        auto read(size_t size) -> u8_view
+        {
+            if (remaining() < size)
+            {
+                throw io_error("unexpected EOB");
+            }
+            auto view = data.subspan(pos, size);
+            pos += size;
+            return view;
+        }
+
+        auto read(u8_slice buf)
+        {
+            auto view = read(buf.size());
+            std::copy(view.begin(), view.end(), buf.begin());
+        }
+
+        auto off() const -> size_t { return pos; }
+        auto remaining() const -> size_t { return data.size() - pos; }
+
+        void skip(size_t size)
+        {
+            if (remaining() < size)
+            {
+                throw io_error("unexpected EOB");
+            }
+            pos += size;
+        }
+    };
 } // namespace sbrt
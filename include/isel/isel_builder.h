@@ -5,7 +5,6 @@
 #include <array>
 #include <cstddef>
 #include <utility>
-#include <vector>
 
 namespace sbrt::isel
 {
@@ -27,6 +26,20 @@ namespace sbrt::isel
             {
                 return node->type.primitive() == Primitive && T::_fast_match(node);
             }
+
+            template <size_t I, size_t N>
+            inline static constexpr auto _try(ir_dag_node* node, std::array<ir_dag_node*, N>& out) -> bool
+            {
+                return node->type.primitive() == Primitive && T::template _try<I>(node, out);
+            }
+
+            template <size_t I, size_t N>
+            inline static constexpr auto _fast_try(ir_dag_node* node, std::array<ir_dag_node*, N>& out) -> bool
+            {
+                return node->type.primitive() == Primitive && T::template _fast_try<I>(node, out);
+            }
+
+            inline static void _leaves(ir_dag_node* node, auto& out) { T::_leaves(node, out); }
         };
 
         template <typename T>
@@ -39,6 +52,19 @@ namespace sbrt::isel
             } -> std::convertible_to<size_t>;
         };
 
+        /**
+         * offsets[i] is where the i-th child matcher starts writing into the argument list
+         */
+        template <typename... Ts>
+        inline constexpr auto child_offsets = []() {
+            std::array<size_t, sizeof...(Ts) + 1> offsets{};
+            size_t sizes[] = {Ts::_eat_size..., 0};
+            for (size_t i = 0; i < sizeof...(Ts); i++)
+            {
+                offsets[i + 1] = offsets[i] + sizes[i];
+            }
+            return offsets;
+        }();
     } // namespace detail
 
     template <auto Bool, auto U8, auto U16, auto U32, auto U64, auto Ptr>
@@ -66,6 +92,14 @@ namespace sbrt::isel
         }
     };
 
+    /*
+     * Matchers expose _match (a pure predicate) and _try<I>, which matches and writes the captured nodes into the
+     * argument list starting at I in the same walk, so a rule never has to re-run its sub-matches to collect them.
+     * The _fast_ variants skip the opcode check, for when the caller already dispatched on the opcode.
+     * _leaves, called on a node the matcher accepted, lists the nodes the pattern still needs as values (everything it
+     * touches but does not absorb), which is what cost based selection charges for.
+     */
+
     /**
      * Consumes any node, and adds it to the argument list
      */
@@ -76,12 +110,22 @@ namespace sbrt::isel
 
         inline static constexpr size_t _eat_size = 1;
         inline static constexpr auto _match(ir_dag_node* /*unused*/) -> bool { return true; }
+        inline static constexpr auto _fast_match(ir_dag_node* /*unused*/) -> bool { return true; }
 
         template <size_t I, size_t N>
-        inline static constexpr void _prepare_args(ir_dag_node* node, std::array<ir_dag_node*, N>& out)
+        inline static constexpr auto _try(ir_dag_node* node, std::array<ir_dag_node*, N>& out) -> bool
         {
             out[I] = node;
+            return true;
         }
+
+        template <size_t I, size_t N>
+        inline static constexpr auto _fast_try(ir_dag_node* node, std::array<ir_dag_node*, N>& out) -> bool
+        {
+            return _try<I>(node, out);
+        }
+
+        inline static void _leaves(ir_dag_node* node, auto& out) { out.push_back(node); }
     };
 
     template <detail::sel_dag_node_matcher T>
@@ -94,25 +138,44 @@ namespace sbrt::isel
         inline static constexpr auto _fast_match(ir_dag_node* node) -> bool { return T::_fast_match(node); }
 
         template <size_t I, size_t N>
-        inline static constexpr void _prepare_args(ir_dag_node* node, std::array<ir_dag_node*, N>& out)
+        inline static constexpr auto _try(ir_dag_node* node, std::array<ir_dag_node*, N>& out) -> bool
         {
             out[I] = node;
-            T::template _prepare_args<I + 1>(node, out);
+            return T::template _try<I + 1>(node, out);
         }
+
+        template <size_t I, size_t N>
+        inline static constexpr auto _fast_try(ir_dag_node* node, std::array<ir_dag_node*, N>& out) -> bool
+        {
+            out[I] = node;
+            return T::template _fast_try<I + 1>(node, out);
+        }
+
+        inline static void _leaves(ir_dag_node* node, auto& out) { T::_leaves(node, out); }
     };
 
     struct skip
     {
         template <ir_types::primitives Primitive>
-        using typed = detail::type_delegate_impl<eat, Primitive>;
+        using typed = detail::type_delegate_impl<skip, Primitive>;
 
         inline static constexpr size_t _eat_size = 0;
         inline static constexpr auto _match(ir_dag_node* /*unused*/) -> bool { return true; }
+        inline static constexpr auto _fast_match(ir_dag_node* /*unused*/) -> bool { return true; }
 
-        template <size_t I>
-        inline static constexpr void _prepare_args(ir_dag_node* /*node*/, auto& /*out*/)
+        template <size_t I, size_t N>
+        inline static constexpr auto _try(ir_dag_node* /*node*/, std::array<ir_dag_node*, N>& /*out*/) -> bool
+        {
+            return true;
+        }
+
+        template <size_t I, size_t N>
+        inline static constexpr auto _fast_try(ir_dag_node* /*node*/, std::array<ir_dag_node*, N>& /*out*/) -> bool
         {
+            return true;
         }
+
+        inline static void _leaves(ir_dag_node* /*node*/, auto& /*out*/) {}
     };
 
     /**
@@ -128,17 +191,11 @@ namespace sbrt::isel
             return (Ts::_match(instr->operands[Index]) && ... && true);
         }
 
-        template <size_t N, size_t I, size_t CI>
-        inline static constexpr void _prepare_args_impl(std::vector<ir_dag_node*>& operands, std::array<ir_dag_node*, N>& out)
+        template <size_t I, size_t N, size_t... Index>
+        inline static constexpr auto _do_child_try(std::index_sequence<Index...> /*unused*/, ir_dag_node* instr, std::array<ir_dag_node*, N>& out)
+            -> bool
         {
-        }
-
-        // TODO: use fold expression to speed up compile
-        template <size_t N, size_t I, size_t CI, detail::sel_dag_node_matcher V, detail::sel_dag_node_matcher... Rest>
-        inline static constexpr void _prepare_args_impl(std::vector<ir_dag_node*>& operands, std::array<ir_dag_node*, N>& out)
-        {
-            V::_prepare_args<I>(operands[CI], out);
-            _prepare_args_impl<N, I + V::_eat_size, CI + 1, Rest...>(operands, out);
+            return (Ts::template _try<I + detail::child_offsets<Ts...>[Index]>(instr->operands[Index], out) && ... && true);
         }
 
     public:
@@ -162,15 +219,66 @@ namespace sbrt::isel
         }
 
         template <size_t I, size_t N>
-        inline static constexpr void _prepare_args(ir_dag_node* node, std::array<ir_dag_node*, N>& out)
+        inline static constexpr auto _try(ir_dag_node* instr, std::array<ir_dag_node*, N>& out) -> bool
+        {
+            return instr->opcode == OPC && _fast_try<I>(instr, out);
+        }
+
+        template <size_t I, size_t N>
+        inline static constexpr auto _fast_try(ir_dag_node* instr, std::array<ir_dag_node*, N>& out) -> bool
         {
-            _prepare_args_impl<N, I, 0, Ts...>(node->operands, out);
+            if (sizeof...(Ts) > instr->operands.size())
+            {
+                return false;
+            }
+
+            return _do_child_try<I>(std::index_sequence_for<Ts...>{}, instr, out);
+        }
+
+        inline static void _leaves(ir_dag_node* instr, auto& out)
+        {
+            [&]<size_t... Index>(std::index_sequence<Index...> /*unused*/) {
+                (Ts::_leaves(instr->operands[Index], out), ...);
+            }(std::index_sequence_for<Ts...>{});
+
+            // operands without a constraint are passed through as values, as n2n does
+            for (size_t i = sizeof...(Ts); i < instr->operands.size(); i++)
+            {
+                out.push_back(instr->operands[i]);
+            }
         }
     };
 
     template <ir_opcode Opc, detail::sel_dag_node_matcher... Ts>
     using sel_cap = capture<sel<Opc, Ts...>>;
 
+    /**
+     * Only matches when the node has a single user, so folding it into the parent pattern does not duplicate work
+     */
+    template <detail::sel_dag_node_matcher T>
+    struct one_use
+    {
+        inline static constexpr auto OPC = T::OPC;
+
+        inline static constexpr size_t _eat_size = T::_eat_size;
+        inline static constexpr auto _match(ir_dag_node* node) -> bool { return node->has_one_use() && T::_match(node); }
+        inline static constexpr auto _fast_match(ir_dag_node* node) -> bool { return node->has_one_use() && T::_fast_match(node); }
+
+        template <size_t I, size_t N>
+        inline static constexpr auto _try(ir_dag_node* node, std::array<ir_dag_node*, N>& out) -> bool
+        {
+            return node->has_one_use() && T::template _try<I>(node, out);
+        }
+
+        template <size_t I, size_t N>
+        inline static constexpr auto _fast_try(ir_dag_node* node, std::array<ir_dag_node*, N>& out) -> bool
+        {
+            return node->has_one_use() && T::template _fast_try<I>(node, out);
+        }
+
+        inline static void _leaves(ir_dag_node* node, auto& out) { T::_leaves(node, out); }
+    };
+
     template <ir_opcode opc, detail::sel_dag_node_matcher L, detail::sel_dag_node_matcher R>
     struct sel_comm
     {
@@ -183,22 +291,43 @@ namespace sbrt::isel
         inline static constexpr auto _match(ir_dag_node* instr) -> bool { return instr->opcode == OPC && _fast_match(instr); }
         inline static constexpr auto _fast_match(ir_dag_node* instr) -> bool
         {
-            return (L::_match(instr->operands[0]) && R::_match(instr->operands[1])) ||
-                   (R::_match(instr->operands[0]) && L::_match(instr->operands[1]));
+            return instr->operands.size() >= 2 && ((L::_match(instr->operands[0]) && R::_match(instr->operands[1])) ||
+                                                   (R::_match(instr->operands[0]) && L::_match(instr->operands[1])));
+        }
+
+        template <size_t I, size_t N>
+        inline static constexpr auto _try(ir_dag_node* instr, std::array<ir_dag_node*, N>& out) -> bool
+        {
+            return instr->opcode == OPC && _fast_try<I>(instr, out);
         }
 
         template <size_t I, size_t N>
-        inline static constexpr void _prepare_args(ir_dag_node* instr, std::array<ir_dag_node*, N>& out)
+        inline static constexpr auto _fast_try(ir_dag_node* instr, std::array<ir_dag_node*, N>& out) -> bool
         {
-            if (L::_match(instr->operands[0]) && R::_match(instr->operands[1]))
+            if (instr->operands.size() < 2)
             {
-                L::template _prepare_args<I>(instr->operands[0], out);
-                R::template _prepare_args<I + L::_eat_size>(instr->operands[1], out);
+                return false;
+            }
+
+            auto* lhs = instr->operands[0];
+            auto* rhs = instr->operands[1];
+            return (L::template _try<I>(lhs, out) && R::template _try<I + L::_eat_size>(rhs, out)) ||
+                   (L::template _try<I>(rhs, out) && R::template _try<I + L::_eat_size>(lhs, out));
+        }
+
+        inline static void _leaves(ir_dag_node* instr, auto& out)
+        {
+            auto* lhs = instr->operands[0];
+            auto* rhs = instr->operands[1];
+            if (L::_match(lhs) && R::_match(rhs))
+            {
+                L::_leaves(lhs, out);
+                R::_leaves(rhs, out);
             }
             else
             {
-                L::template _prepare_args<I>(instr->operands[1], out);
-                R::template _prepare_args<I + L::_eat_size>(instr->operands[0], out);
+                L::_leaves(rhs, out);
+                R::_leaves(lhs, out);
             }
         }
     };
@@ -285,4 +414,28 @@ namespace sbrt::isel
 
         inline static constexpr auto _expand = false;
     };
+
+    /**
+     * Attaches a cost to a rule, used by cost based selection. Rules without one cost 1.
+     */
+    template <size_t Cost, typename Rule>
+    struct with_cost : Rule
+    {
+        inline static constexpr size_t cost = Cost;
+    };
+
+    namespace detail
+    {
+        template <typename Rule>
+        inline constexpr size_t rule_cost = []() {
+            if constexpr (requires { Rule::cost; })
+            {
+                return Rule::cost;
+            }
+            else
+            {
+                return size_t{1};
+            }
+        }();
+    } // namespace detail
 } // namespace sbrt::isel
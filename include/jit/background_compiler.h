@@ -0,0 +1,85 @@
+#pragma once
+
+#include "arch/x86/encoder.h"
+#include "arch/x86/regalloc.h"
+#include "common.h"
+#include "instr/ir.h"
+#include "io.h"
+#include "jit/lowering.h"
+#include "pass/pass.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <expected.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sbrt::jit
+{
+    /**
+     * A block compiled off the execution threads. The code is position independent, so it is installed by copying it
+     * into the code cache as is.
+     */
+    struct compiled_block
+    {
+        u8_buf code;
+        x86::encoded_block layout;
+    };
+
+    /**
+     * Outcome of compiling one submitted pc, successful or not
+     */
+    struct compile_result
+    {
+        uint64_t guest_pc;
+        tl::expected<compiled_block, error> block;
+    };
+
+    /**
+     * Worker pool that compiles hot blocks at the optimizing tier: frontend, optimizer, isel, register allocation and
+     * encoding all run on the workers, into buffers of their own. Finished blocks are collected by the thread that owns
+     * the code cache, which installs and publishes them; neither submitting nor collecting waits for a compile. A
+     * compile that throws comes back as a failed result rather than taking the worker down.
+     */
+    class background_compiler
+    {
+        block_frontend source;
+        const transformer<ir::ir_dag>& optimizer;
+
+        std::mutex queue_mutex;
+        std::condition_variable queue_ready;
+        std::deque<uint64_t> queue;
+        bool stopping = false;
+
+        std::mutex done_mutex;
+        std::vector<compile_result> done;
+
+        std::vector<std::jthread> workers;
+
+        void work();
+        auto compile(uint64_t guest_pc, x86::linear_scan_allocator& allocator) -> tl::expected<compiled_block, error>;
+
+    public:
+        /**
+         * `source` and `optimizer` are used from every worker at once, and have to outlive the compiler
+         */
+        background_compiler(block_frontend source, const transformer<ir::ir_dag>& optimizer, size_t threads);
+        background_compiler(const background_compiler&) = delete;
+        auto operator=(const background_compiler&) -> background_compiler& = delete;
+
+        /**
+         * Stops the workers; blocks still queued are dropped
+         */
+        ~background_compiler();
+
+        void submit(uint64_t guest_pc);
+
+        /**
+         * Moves every finished result into `out`. Returns immediately if a worker is handing in a result right now, the
+         * rest is picked up by the next call.
+         */
+        void collect(std::vector<compile_result>& out);
+    };
+} // namespace sbrt::jit
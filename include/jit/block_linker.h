@@ -0,0 +1,71 @@
+#pragma once
+
+#include "arch/x86/encoder.h"
+#include "jit/code_cache.h"
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace sbrt::jit
+{
+    /**
+     * Direct chaining between translated blocks. A block with a constant successor ends in a patchable jump (see
+     * x86::encoded_block) that returns to the dispatcher until it is linked; linking rewrites it to jump straight into
+     * the successor, and unlinking points it back at the `ret`. Links are made lazily, the first time the dispatcher
+     * resolves a block's successor.
+     *
+     * Chained blocks are entered with the frame of the predecessor already popped, so the successor's `ret` goes back
+     * to whoever called the first block of the chain.
+     *
+     * Not thread safe; linking shares the single writer of the code cache.
+     */
+    class block_linker
+    {
+        struct exit_site
+        {
+            // executable address of the rel32 to patch
+            uintptr_t patch;
+            uint64_t next_pc;
+            // entry of the block the exit currently jumps to, 0 when unlinked
+            uintptr_t target;
+        };
+
+        code_cache& cache;
+        // keyed by entry of the block owning the exit
+        std::unordered_map<uintptr_t, exit_site> exits;
+        // entry of a block -> entries of the blocks whose exits jump into it
+        std::unordered_map<uintptr_t, std::vector<uintptr_t>> incoming;
+
+        void patch(exit_site& exit, uintptr_t target);
+        void drop_incoming(uintptr_t target, uintptr_t source);
+
+    public:
+        block_linker(code_cache& cache) : cache(cache) {}
+
+        /**
+         * Registers a block installed at `entry`, blocks without a chainable exit are ignored
+         */
+        void add_block(uintptr_t entry, const x86::encoded_block& block);
+
+        /**
+         * Guest pc the chainable exit of `source` goes to, or nullopt if it has none
+         */
+        [[nodiscard]] auto next_pc_of(uintptr_t source) const -> std::optional<uint64_t>;
+
+        /**
+         * Makes the exit of `source` jump straight to `target`, which must be the block for its next pc
+         */
+        void link(uintptr_t source, uintptr_t target);
+
+        /**
+         * Sends every exit that jumps into `target` back to the dispatcher, for when `target` is replaced
+         */
+        void unlink_target(uintptr_t target);
+
+        /**
+         * Forgets the blocks in [begin, end) and unlinks every jump into them, for when the code cache evicts a region
+         */
+        void evict_range(uintptr_t begin, uintptr_t end);
+    };
+} // namespace sbrt::jit
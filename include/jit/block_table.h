@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace sbrt::jit
+{
+    /**
+     * Shared map from guest pc to the host code of its translated block, as a fixed size open addressing table.
+     *
+     * Lookups are lock free and may run concurrently with inserts from translation threads: a slot's key is claimed
+     * once with a CAS and never moves, and its host address is published after it, so a reader either sees a complete
+     * entry or a miss. Erasing only clears the host address (the key keeps its slot). Erasing or replacing a block bumps
+     * the epoch so that per-thread lookup caches drop what they copied. The pc that doubles as the EMPTY key is kept
+     * outside the table, in a slot of its own.
+     */
+    class block_table
+    {
+        struct entry
+        {
+            std::atomic<uint64_t> guest;
+            std::atomic<uintptr_t> host;
+        };
+
+        std::unique_ptr<entry[]> entries;
+        size_t mask;
+        // host address of the block for guest pc EMPTY, which cannot be a key
+        std::atomic<uintptr_t> empty_host = 0;
+        std::atomic<size_t> claimed = 0;
+        std::atomic<uint64_t> epoch = 0;
+
+        /**
+         * Counts a slot as claimed before it is taken, so concurrent inserts cannot push the table past its load
+         * limit; the reservation is given back if the slot turns out to be taken
+         */
+        auto reserve_claim() -> bool;
+
+    public:
+        inline static constexpr uint64_t EMPTY = UINT64_MAX;
+
+        static constexpr auto hash(uint64_t guest) -> size_t { return (guest * 0x9e3779b97f4a7c15ULL) >> 17; }
+
+        /**
+         * `capacity` is rounded up to a power of two; inserts start failing once 3/4 of it has been claimed
+         */
+        explicit block_table(size_t capacity = size_t(1) << 16);
+
+        /**
+         * Host address of the block for `guest`, or 0 if there is none
+         */
+        [[nodiscard]] auto lookup(uint64_t guest) const -> uintptr_t
+        {
+            if (guest == EMPTY)
+            {
+                return empty_host.load(std::memory_order_acquire);
+            }
+
+            for (size_t slot = hash(guest) & mask;; slot = (slot + 1) & mask)
+            {
+                uint64_t key = entries[slot].guest.load(std::memory_order_acquire);
+                if (key == guest)
+                {
+                    return entries[slot].host.load(std::memory_order_acquire);
+                }
+
+                if (key == EMPTY)
+                {
+                    return 0;
+                }
+            }
+        }
+
+        /**
+         * Adds or replaces the block for `guest`. Returns false if the table is too full to take a new pc, in which
+         * case the owner is expected to reset() it at the next point where no thread is looking anything up.
+         */
+        auto insert(uint64_t guest, uintptr_t host) -> bool;
+
+        void erase(uint64_t guest);
+
+        /**
+         * Erases every block whose host code lies in [begin, end), for when the code cache evicts a region
+         */
+        void erase_host_range(uintptr_t begin, uintptr_t end);
+
+        /**
+         * Empties the table, including claimed keys. Not safe against concurrent lookups.
+         */
+        void reset();
+
+        [[nodiscard]] auto get_epoch() const -> uint64_t { return epoch.load(std::memory_order_acquire); }
+    };
+
+    /**
+     * Direct mapped cache in front of a block_table, owned by a single executing thread. Hits cost one relaxed load of
+     * the table epoch and one compare; everything cached is dropped when the table erases or replaces a block.
+     */
+    class block_lookup_cache
+    {
+        inline static constexpr size_t SIZE = 4096;
+
+        struct entry
+        {
+            uint64_t guest = block_table::EMPTY;
+            uintptr_t host = 0;
+        };
+
+        const block_table& table;
+        uint64_t epoch;
+        std::array<entry, SIZE> entries{};
+
+        static constexpr auto index(uint64_t guest) -> size_t { return (guest ^ (guest >> 12)) & (SIZE - 1); }
+
+    public:
+        block_lookup_cache(const block_table& table) : table(table), epoch(table.get_epoch()) {}
+
+        [[nodiscard]] auto lookup(uint64_t guest) -> uintptr_t
+        {
+            uint64_t current = table.get_epoch();
+            if (current != epoch)
+            {
+                entries.fill({});
+                epoch = current;
+            }
+
+            // only blocks that exist are cached, which also keeps guest pc EMPTY from hitting an unused entry
+            auto& cached = entries[index(guest)];
+            if (cached.guest == guest && cached.host != 0)
+            {
+                return cached.host;
+            }
+
+            uintptr_t host = table.lookup(guest);
+            if (host != 0)
+            {
+                cached = {guest, host};
+            }
+            return host;
+        }
+    };
+} // namespace sbrt::jit
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "cast.h"
+#include "common.h"
+#include "io.h"
+#include <cstddef>
+#include <cstdint>
+#include <expected.h>
+#include <functional>
+#include <span>
+#include <vector>
+
+namespace sbrt::jit
+{
+    /**
+     * Space handed out by code_cache::reserve. Code is written through `writable` and runs from `exec`; the two are
+     * different addresses of the same memory when the cache is dual mapped.
+     */
+    struct code_reservation
+    {
+        u8_slice writable;
+        uintptr_t exec;
+    };
+
+    /**
+     * Cache of translated code over one large mapping, split into a ring of equally sized regions that blocks are bump
+     * allocated out of. When the current region fills up, the next one in the ring (the oldest) is evicted as a whole
+     * and reused, so flushing costs nothing per block and recently translated code stays packed together.
+     *
+     * Where possible the memory is mapped twice, once writable and once executable, so installing a block never
+     * changes page protections. Otherwise there is a single mapping that is executable outside of write scopes, and
+     * made writable region by region for the duration of a scope; no code may run out of the region being written
+     * while a scope is open in that mode. Link patches leave the patched region executable.
+     *
+     * Not thread safe, the cache expects a single writer.
+     */
+    class code_cache
+    {
+    public:
+        /**
+         * Called with the executable address range of a region before it is reused, so anything pointing into it can
+         * be dropped
+         */
+        using evict_callback = std::function<void(uintptr_t begin, uintptr_t end)>;
+
+        inline static constexpr size_t BLOCK_ALIGNMENT = 16;
+
+    private:
+        uint8_t* rw_view = nullptr;
+        uint8_t* rx_view = nullptr;
+        size_t capacity = 0;
+        size_t region_size = 0;
+        bool dual_mapped = false;
+
+        size_t current_region = 0;
+        // offset of the next free byte, inside the current region
+        size_t bump = 0;
+        // bumped every time the region is evicted
+        std::vector<uint64_t> region_generations;
+        size_t write_depth = 0;
+        bool reserved = false;
+        evict_callback on_evict;
+
+        code_cache(uint8_t* rw_view, uint8_t* rx_view, size_t capacity, size_t regions, bool dual_mapped);
+
+        void release();
+        void protect_region(size_t region, int protection);
+        void evict_region(size_t region);
+        void advance_region();
+
+    public:
+        code_cache(const code_cache&) = delete;
+        auto operator=(const code_cache&) -> code_cache& = delete;
+        code_cache(code_cache&& other) noexcept;
+        auto operator=(code_cache&& other) noexcept -> code_cache&;
+        ~code_cache();
+
+        /**
+         * Maps a cache of `capacity` bytes (rounded up to whole pages per region) split into `regions` generations
+         */
+        static auto create(size_t capacity, size_t regions = 4) -> tl::expected<code_cache, error>;
+
+        /**
+         * Makes the current region writable until the matching end_write(); free when the cache is dual mapped.
+         * Scopes nest.
+         */
+        void begin_write();
+        void end_write();
+
+        /**
+         * Reserves up to `size` bytes for a block, which has to be finished with commit() before the next reservation.
+         * May evict the oldest region to make room.
+         */
+        auto reserve(size_t size) -> tl::expected<code_reservation, error>;
+
+        /**
+         * Keeps the first `used` bytes of the last reservation and gives the rest back
+         */
+        void commit(const code_reservation& reservation, size_t used);
+
+        /**
+         * Copies `code` into the cache and returns its executable address
+         */
+        auto install(std::span<const uint8_t> code) -> tl::expected<uintptr_t, error>;
+
+        /**
+         * Atomically overwrites the 4-byte aligned word at executable address `exec`, which may be in a block that is
+         * running on another thread. Without a dual mapping the region is made writable and executable at once for the
+         * duration of the store, so code running out of it keeps going; a region with a write scope open is not
+         * executable in that mode, so nothing can be running in it.
+         */
+        void patch_u32(uintptr_t exec, uint32_t value);
+
+        /**
+         * Evicts every region
+         */
+        void flush();
+
+        void set_evict_callback(evict_callback callback) { on_evict = std::move(callback); }
+
+        [[nodiscard]] auto is_dual_mapped() const -> bool { return dual_mapped; }
+        [[nodiscard]] auto contains(uintptr_t address) const -> bool
+        {
+            return address >= as_uptr(rx_view) && address < as_uptr(rx_view) + capacity;
+        }
+
+        /**
+         * Generation of the region holding `address`; a block is still in the cache iff this has not changed since it
+         * was installed
+         */
+        [[nodiscard]] auto generation_of(uintptr_t address) const -> uint64_t
+        {
+            return region_generations[(address - as_uptr(rx_view)) / region_size];
+        }
+
+        [[nodiscard]] auto get_capacity() const -> size_t { return capacity; }
+    };
+
+    /**
+     * RAII write scope over a code_cache
+     */
+    class code_cache_writer
+    {
+        code_cache& cache;
+
+    public:
+        code_cache_writer(code_cache& cache) : cache(cache) { cache.begin_write(); }
+        code_cache_writer(const code_cache_writer&) = delete;
+        auto operator=(const code_cache_writer&) -> code_cache_writer& = delete;
+        ~code_cache_writer() { cache.end_write(); }
+    };
+} // namespace sbrt::jit
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "arch/x86/instr.h"
+#include "common.h"
+#include "instr/ir.h"
+#include "pass/pass.h"
+#include <cstdint>
+#include <expected.h>
+#include <functional>
+
+namespace sbrt::jit
+{
+    enum class tier
+    {
+        // ir_to_isel + first match isel + encode, no optimization
+        BASELINE,
+        // the optimization pipeline, then optimal isel
+        OPTIMIZED
+    };
+
+    /**
+     * Produces the ir of the guest block starting at a pc; called again for the same pc when it tiers up, possibly from
+     * a background compile thread
+     */
+    using block_frontend = std::function<tl::expected<ir::ir_dag, error>(uint64_t guest_pc)>;
+
+    /**
+     * Runs the ir of `guest_pc` through the passes of `level` up to instruction selection. `optimizer` is only used by
+     * the optimizing tier. Only calls const pass methods, so it may run on several threads at once.
+     */
+    auto select_block(const block_frontend& source, uint64_t guest_pc, tier level, const transformer<ir::ir_dag>& optimizer)
+        -> tl::expected<x86::mc_x86_dag, error>;
+} // namespace sbrt::jit
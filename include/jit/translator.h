@@ -0,0 +1,105 @@
+#pragma once
+
+#include "arch/x86/encoder.h"
+#include "arch/x86/regalloc.h"
+#include "arena.h"
+#include "common.h"
+#include "instr/ir.h"
+#include "jit/background_compiler.h"
+#include "jit/block_linker.h"
+#include "jit/block_table.h"
+#include "jit/code_cache.h"
+#include "jit/lowering.h"
+#include "pass/pass.h"
+#include <cstdint>
+#include <expected.h>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace sbrt::jit
+{
+    /**
+     * Translates guest blocks in two tiers, and dispatches between them.
+     *
+     * Every block is first translated at the baseline tier, with an entry counter in its prologue. Once the counter
+     * runs out the block exits to the dispatcher as hot before running, and is translated again at the optimizing
+     * tier; the optimized code replaces it in the lookup table and every chained jump into the old code is unlinked.
+     * With a background compiler the optimizing tier runs on its workers instead, and the block keeps running at the
+     * baseline tier until the dispatcher picks the result up.
+     *
+     * Owns the eviction callback of the code cache, and must not move while the cache is alive.
+     */
+    class tiered_translator
+    {
+    public:
+        using frontend = block_frontend;
+
+    private:
+        struct block_record
+        {
+            // 0 while the block has no code in the cache
+            uintptr_t entry = 0;
+            tier level = tier::BASELINE;
+            int64_t* counter = nullptr;
+            // handed to the background compiler and not back yet
+            bool queued = false;
+        };
+
+        code_cache& cache;
+        block_table& table;
+        block_linker& linker;
+        frontend source;
+        transformer_ref<ir::ir_dag> optimizer;
+        int64_t hot_threshold;
+        background_compiler* background = nullptr;
+
+        x86::linear_scan_allocator allocator;
+        std::vector<compile_result> finished;
+
+        std::unordered_map<uint64_t, block_record> blocks;
+        bump_arena counters;
+        block_lookup_cache lookup_cache;
+        uintptr_t last_entry = 0;
+
+        auto emit(uint64_t guest_pc, x86::mc_x86_dag&& dag, int64_t* counter) -> tl::expected<uintptr_t, error>;
+        void evict(uintptr_t begin, uintptr_t end);
+        auto publish(uint64_t guest_pc, tier level, uintptr_t entry) -> uintptr_t;
+        auto install_finished() -> tl::expected<void, error>;
+        void queue_optimization(uint64_t guest_pc);
+
+    public:
+        tiered_translator(
+            code_cache& cache, block_table& table, block_linker& linker, frontend source, transformer_ref<ir::ir_dag> optimizer,
+            int64_t hot_threshold = 1000
+        );
+        tiered_translator(const tiered_translator&) = delete;
+        auto operator=(const tiered_translator&) -> tiered_translator& = delete;
+
+        /**
+         * Sends hot blocks to `compiler` from now on, which has to use the same frontend and optimizer
+         */
+        void compile_in_background(background_compiler& compiler) { background = &compiler; }
+
+        /**
+         * Translates `guest_pc` at `level` and publishes it, replacing whatever code the pc had
+         */
+        auto translate(uint64_t guest_pc, tier level) -> tl::expected<uintptr_t, error>;
+
+        /**
+         * Host code for `guest_pc`, translated at the baseline tier on a miss. A pc that was optimized before its code
+         * was evicted goes straight back to the background compiler, if there is one, rather than being optimized on
+         * the executing thread.
+         */
+        auto resolve(uint64_t guest_pc) -> tl::expected<uintptr_t, error>;
+
+        /**
+         * One round trip through the dispatcher: runs guest code from `guest_pc` until it comes back, tiering up the
+         * block that came back hot if there is one, and returns the pc to continue at
+         */
+        auto step(uint64_t guest_pc) -> tl::expected<uint64_t, error>;
+
+        [[nodiscard]] auto tier_of(uint64_t guest_pc) const -> std::optional<tier>;
+        [[nodiscard]] auto get_optimizer() const -> const transformer<ir::ir_dag>& { return *optimizer; }
+    };
+} // namespace sbrt::jit
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "small_vector.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace sbrt
+{
+    /**
+     * Identifies an analysis without RTTI; one distinct address per analysis type
+     */
+    using analysis_key = const void*;
+
+    template <typename A>
+    inline constexpr char analysis_key_of = 0;
+
+    template <typename A>
+    constexpr auto key_of() -> analysis_key
+    {
+        return &analysis_key_of<A>;
+    }
+
+    /**
+     * The analyses a pass leaves valid. Passes that do not say otherwise preserve none.
+     */
+    class preserved_analyses
+    {
+        bool everything = false;
+        // inline, as passes hand these out after every run
+        small_vector<analysis_key, 4> keys;
+
+    public:
+        static auto none() -> preserved_analyses { return {}; }
+        static auto all() -> preserved_analyses
+        {
+            preserved_analyses result;
+            result.everything = true;
+            return result;
+        }
+
+        template <typename... As>
+        static auto only() -> preserved_analyses
+        {
+            preserved_analyses result;
+            result.keys = {key_of<As>()...};
+            return result;
+        }
+
+        [[nodiscard]] auto preserves(analysis_key key) const -> bool { return everything || std::ranges::find(keys, key) != keys.end(); }
+        [[nodiscard]] auto preserves_all() const -> bool { return everything; }
+    };
+
+    /**
+     * Cache of analysis results for a single dag, as it goes through the passes of one pipeline run.
+     *
+     * An analysis is a type `A` constructible from `(T& dag, analysis_manager<T>& analyses)`, the result being the
+     * object itself; it may request other analyses while it is built. Results are kept until a pass that does not
+     * preserve them has run, so they must not hold anything that a preserving pass may change, and node ids only
+     * stay meaningful until a pass compacts them.
+     */
+    template <typename T>
+    class analysis_manager
+    {
+        struct result_base
+        {
+            virtual ~result_base() = default;
+        };
+
+        template <typename A>
+        struct result final : result_base
+        {
+            A value;
+
+            result(T& dag, analysis_manager& analyses) : value(dag, analyses) {}
+        };
+
+        struct entry
+        {
+            analysis_key key;
+            std::unique_ptr<result_base> value;
+        };
+
+        // few analyses are alive at once, so a linear scan beats hashing
+        std::vector<entry> entries;
+
+        auto find(analysis_key key) -> entry*
+        {
+            auto it = std::ranges::find(entries, key, &entry::key);
+            return it == entries.end() ? nullptr : &*it;
+        }
+
+    public:
+        analysis_manager() = default;
+        analysis_manager(const analysis_manager&) = delete;
+        auto operator=(const analysis_manager&) -> analysis_manager& = delete;
+
+        /**
+         * Result of `A` for `dag`, computed now if it is not cached. The reference is valid until `A` is invalidated.
+         * Analyses that support incremental updates are updated through it by the passes that preserve them.
+         */
+        template <typename A>
+        auto get(T& dag) -> A&
+        {
+            if (auto* cached = find(key_of<A>()))
+            {
+                return static_cast<result<A>*>(cached->value.get())->value;
+            }
+
+            // built before inserting, since building may request (and insert) other analyses
+            auto computed = std::make_unique<result<A>>(dag, *this);
+            A& value = computed->value;
+            entries.push_back({key_of<A>(), std::move(computed)});
+            return value;
+        }
+
+        /**
+         * Cached result of `A`, or null; never computes anything
+         */
+        template <typename A>
+        auto get_if_cached() -> A*
+        {
+            auto* cached = find(key_of<A>());
+            return cached == nullptr ? nullptr : &static_cast<result<A>*>(cached->value.get())->value;
+        }
+
+        template <typename A>
+        void invalidate()
+        {
+            std::erase_if(entries, [](const entry& curr) { return curr.key == key_of<A>(); });
+        }
+
+        /**
+         * Drops every result that `preserved` does not cover
+         */
+        void invalidate(const preserved_analyses& preserved)
+        {
+            if (!preserved.preserves_all())
+            {
+                std::erase_if(entries, [&](const entry& curr) { return !preserved.preserves(curr.key); });
+            }
+        }
+
+        void clear() { entries.clear(); }
+        [[nodiscard]] auto empty() const -> bool { return entries.empty(); }
+    };
+
+    /**
+     * Topological order of the nodes reachable from the root, operands and chains first, with each node's position
+     * indexed by node id. Valid as long as no node is added, removed or rewired.
+     */
+    template <typename T>
+    class topological_order
+    {
+        using node_type = std::remove_pointer_t<decltype(std::declval<T&>().root())>;
+
+        std::vector<node_type*> order;
+        std::vector<size_t> positions;
+
+    public:
+        static constexpr size_t UNREACHABLE = SIZE_MAX;
+
+        topological_order(T& dag, analysis_manager<T>& /*analyses*/) : positions(dag.max_node_id(), UNREACHABLE)
+        {
+            auto walk = dag.post_order();
+            order.assign(walk.begin(), walk.end());
+            for (size_t i = 0; i < order.size(); i++)
+            {
+                positions[order[i]->get_id()] = i;
+            }
+        }
+
+        [[nodiscard]] auto nodes() const -> std::span<node_type* const> { return order; }
+        [[nodiscard]] auto position_of(const node_type* node) const -> size_t { return positions[node->get_id()]; }
+        [[nodiscard]] auto reachable(const node_type* node) const -> bool { return position_of(node) != UNREACHABLE; }
+    };
+} // namespace sbrt
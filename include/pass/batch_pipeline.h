@@ -0,0 +1,69 @@
+#pragma once
+
+#include "common.h"
+#include "pass/pass.h"
+#include "work_stealing_pool.h"
+#include <cstddef>
+#include <exception>
+#include <fmt/core.h>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace sbrt
+{
+    /**
+     * Runs `pass` (usually a pipeline) over every dag of `inputs` in parallel on `pool`, leaving the inputs moved-from.
+     * Passes only get const access to themselves, so a single instance serves every thread. Results, errors included,
+     * come back in input order. Anything a pass throws is caught on the worker and becomes that dag's error on the
+     * calling thread: an sbrt::error as is, other exceptions wrapped in one.
+     */
+    template <typename T, typename U>
+    auto transform_batch(const pass<T, U>& pass, std::span<T> inputs, work_stealing_pool& pool) -> std::vector<typename sbrt::pass<T, U>::result_t>
+    {
+        using result_t = sbrt::pass<T, U>::result_t;
+
+        std::vector<std::optional<result_t>> slots(inputs.size());
+        std::vector<std::exception_ptr> thrown(inputs.size());
+        pool.parallel_for(inputs.size(), [&](size_t index) {
+            try
+            {
+                slots[index].emplace(pass.transform(std::move(inputs[index])));
+            }
+            catch (...)
+            {
+                thrown[index] = std::current_exception();
+            }
+        });
+
+        std::vector<result_t> results;
+        results.reserve(inputs.size());
+        for (size_t i = 0; i < inputs.size(); i++)
+        {
+            if (!thrown[i])
+            {
+                results.push_back(std::move(*slots[i]));
+                continue;
+            }
+
+            try
+            {
+                std::rethrow_exception(thrown[i]);
+            }
+            catch (error& e)
+            {
+                results.push_back(tl::unexpected(std::move(e)));
+            }
+            catch (const std::exception& e)
+            {
+                results.push_back(tl::unexpected(error(fmt::format("pass {} threw: {}", pass.pass_name(), e.what()), submodule::MISC)));
+            }
+            catch (...)
+            {
+                results.push_back(tl::unexpected(error(fmt::format("pass {} threw an unknown exception", pass.pass_name()), submodule::MISC)));
+            }
+        }
+        return results;
+    }
+} // namespace sbrt
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "instr/ir.h"
+#include "pass/analysis.h"
+#include "pass/known_bits_analysis.h"
+#include "pass/pass.h"
+#include <string>
+
+namespace sbrt::passes::opt
+{
+    /**
+     * Folds arithmetic on constants at the width of the node's type, and applies x-x=0, x+0=x, x-0=x, x*1=x, x*0=0,
+     * x/1=x and shifts by 0. A single post-order walk that rewrites nodes in place, so it is cheap enough for the
+     * baseline tier. Divisions by zero, the overflowing signed division and out of range shifts are left alone. The
+     * nodes it makes unreachable are left for dce. A cached known_bits_analysis is updated for what was rewritten
+     * rather than dropped, but never computed just for this pass.
+     */
+    class constant_folding final : public analysis_pass<ir::ir_dag, ir::ir_dag>
+    {
+    public:
+        [[nodiscard]] auto pass_name() const -> std::string override { return "opt::constfold"; }
+
+        auto transform_with(ir::ir_dag&& _dag, analysis_manager<ir::ir_dag>& analyses) const -> result_t override;
+
+        [[nodiscard]] auto preserved() const -> preserved_analyses override { return preserved_analyses::only<known_bits_analysis>(); }
+    };
+} // namespace sbrt::passes::opt
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "instr/ir.h"
+#include "pass/pass.h"
+#include <string>
+
+namespace sbrt::passes::opt
+{
+    /**
+     * Removes nodes that are unreachable from the root, and compacts the remaining node ids
+     */
+    class dead_node_elimination final : public transformer<ir::ir_dag>
+    {
+    public:
+        [[nodiscard]] auto pass_name() const -> std::string override { return "opt::dce"; }
+
+        auto transform(ir::ir_dag&& _dag) const -> result_t override;
+    };
+} // namespace sbrt::passes::opt
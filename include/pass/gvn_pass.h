@@ -0,0 +1,29 @@
+#pragma once
+
+#include "instr/ir.h"
+#include "pass/pass.h"
+#include <string>
+
+namespace sbrt::passes::opt
+{
+    /**
+     * Global value numbering: merges nodes that compute the same value, through replace_all_uses_with, so that
+     * equivalences that only show up after rewrites (or with cse disabled) are caught as well.
+     *
+     * Operands of ADD, MUL and UMULH are put into a canonical order first (constants last, otherwise by node id), and
+     * IMMs are truncated to their width, so `a+b` and `b+a` get the same number. The chain is part of a node's
+     * identity, and nodes that `filter` rejects keep their own number; by default that is every node with a chain,
+     * the same rule the dag uses for cse. The nodes it replaces are left for dce.
+     */
+    class global_value_numbering final : public transformer<ir::ir_dag>
+    {
+        ir::ir_dag::cse_filter_t filter;
+
+    public:
+        global_value_numbering(ir::ir_dag::cse_filter_t filter = ir::ir_dag::cse_chainless) : filter(filter) {}
+
+        [[nodiscard]] auto pass_name() const -> std::string override { return "opt::gvn"; }
+
+        auto transform(ir::ir_dag&& _dag) const -> result_t override;
+    };
+} // namespace sbrt::passes::opt
@@ -4,10 +4,14 @@
 #include "instr/dag.h"
 #include "instr/ir.h"
 #include "pass/pass.h"
+#include "small_vector.h"
 #include <array>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
+#include <span>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -24,124 +28,351 @@ namespace sbrt::passes::isel
         {
             for (auto& node : dag.get_nodes())
             {
-                if (node->type.is_ptr())
-                {
-                    node->type = ir_type_token::PTR;
-                }
+                node->type = lower_type(node->type);
             }
 
             return std::move(dag);
         }
+
+        /**
+         * Same lowering over the dense layout, as a single sweep over the type column
+         */
+        static void lower(ir_dense_dag& dag)
+        {
+            for (auto& type : dag.get_types())
+            {
+                type = lower_type(type);
+            }
+        }
+
+    private:
+        static constexpr auto lower_type(ir_types type) -> ir_types { return type.is_ptr() ? ir_types::PTR : type; }
     };
 
     namespace detail
     {
         template <typename T>
-        struct handler_entry
+        struct flatten_rules
         {
-            bool (*match)(ir_dag_node*);
-            void (*invoke)(ir_dag& ir_dag, ir_dag_node* ir_node, T& dag, T::node_type* target);
+            using type = pack<T>;
         };
 
-        template <typename T>
-        using sel_table_t = std::array<std::vector<handler_entry<T>>, static_cast<size_t>(ir_opcode::MAX)>;
-
-        template <typename T, typename Selector>
-        struct dummy
+        template <typename... Ts>
+        struct flatten_rules<pack<Ts...>>
         {
-            template <size_t... Index>
-            static void expand_invoke(
-                std::index_sequence<Index...> /*ignored*/, ir_dag& ir_dag, ir_dag_node* ir_node, T& dag, T::node_type* target,
-                std::array<ir_dag_node*, Selector::match::_eat_size>& arr
-            )
-            {
-                Selector::invoke(ir_dag, ir_node, dag, target, dag[arr[Index].get_id()]...);
-            }
+            using type = pack_append<typename flatten_rules<Ts>::type...>;
         };
 
-        template <typename T, typename... Selectors>
-        struct dummy<T, pack<Selectors...>>
+        template <typename Rule, typename T, size_t... Index>
+        inline void expand_invoke(
+            std::index_sequence<Index...> /*ignored*/, ir_dag& ir_dag, ir_dag_node* ir_node, T& dag, typename T::node_type* target,
+            const std::array<ir_dag_node*, Rule::match::_eat_size>& args
+        )
         {
-        };
+            Rule::invoke(ir_dag, ir_node, dag, target, dag[args[Index]->get_id()]...);
+        }
 
-        template <typename T, typename... Args>
-        auto operator+(sel_table_t<T>& lhs, dummy<T, pack<Args...>> /*rhs*/) -> sel_table_t<T>&
+        /**
+         * Matches and applies a single rule to a node whose opcode was already checked
+         */
+        template <typename Rule, typename T>
+        inline auto apply_rule(ir_dag& ir_dag, ir_dag_node* ir_node, T& dag, typename T::node_type* target) -> bool
         {
-            (lhs + ... + dummy<T, Args>{});
-            return lhs;
+            std::array<ir_dag_node*, Rule::match::_eat_size> args;
+            if (!Rule::match::template _fast_try<0>(ir_node, args))
+            {
+                return false;
+            }
+
+            if constexpr (Rule::_expand)
+            {
+                expand_invoke<Rule>(std::make_index_sequence<Rule::match::_eat_size>{}, ir_dag, ir_node, dag, target, args);
+            }
+            else
+            {
+                Rule::invoke(ir_dag, ir_node, dag, target, args);
+            }
+
+            return true;
         }
 
-        template <typename T, typename Selector>
-        auto operator+(sel_table_t<T>& lhs, dummy<T, Selector> /*rhs*/) -> sel_table_t<T>&
+        template <ir_opcode Opc, typename Rule, typename T>
+        inline auto apply_rule_for(ir_dag& ir_dag, ir_dag_node* ir_node, T& dag, typename T::node_type* target) -> bool
         {
-            using node_type = T::node_type;
-            if constexpr (Selector::_expand)
+            if constexpr (Rule::match::OPC == Opc)
             {
-                lhs[static_cast<size_t>(Selector::match::OPC)].push_back({
-                    Selector::match::_fast_match,
-                    +[](ir_dag& ir_dag, ir_dag_node* ir_node, T& dag, node_type* target) {
-                        std::array<ir_dag_node*, Selector::match::_eat_size> buffer;
-                        Selector::match::template _prepare_args<0>(ir_node, buffer);
-                        expand_invoke(std::make_index_sequence<Selector::match::_eat_size>{}, ir_dag, ir_node, dag, target, buffer);
-                    },
-                });
+                return apply_rule<Rule>(ir_dag, ir_node, dag, target);
             }
             else
             {
-                lhs[static_cast<size_t>(Selector::match::OPC)].push_back({
-                    Selector::match::_fast_match,
-                    +[](ir_dag& ir_dag, ir_dag_node* ir_node, T& dag, node_type* target) {
-                        std::array<ir_dag_node*, Selector::match::_eat_size> buffer;
-                        Selector::match::template _prepare_args<0>(ir_node, buffer);
-                        Selector::invoke(ir_dag, ir_node, dag, target, buffer);
-                    },
-                });
+                return false;
             }
-            return lhs;
         }
+
+        /**
+         * Rule selection, lowered entirely at compile time: a switch on the opcode, each case trying only the rules
+         * rooted at its opcode, in declaration order with their matchers inlined. Rules picked by the optimal mode are
+         * applied through a fold over the rule index, which compiles to the same kind of jump table. Nothing is called
+         * through a pointer.
+         */
+        template <typename T, typename Rules>
+        struct rule_dispatch;
+
+        template <typename T, typename... Rules>
+        struct rule_dispatch<T, pack<Rules...>>
+        {
+            using node_type = T::node_type;
+            using leaf_list = small_vector<ir_dag_node*, 4>;
+
+            inline static constexpr size_t NO_RULE = sizeof...(Rules);
+            inline static constexpr size_t OPCODE_COUNT = static_cast<size_t>(ir_opcode::MAX);
+
+        private:
+            template <ir_opcode Opc>
+            using opcode_constant = std::integral_constant<ir_opcode, Opc>;
+
+            static_assert(OPCODE_COUNT == 11, "every ir opcode needs a case in on_opcode");
+
+            /**
+             * Calls `fn` with the opcode as a compile time constant
+             */
+            template <typename Fn>
+            inline static auto on_opcode(ir_opcode opcode, Fn&& fn)
+            {
+                switch (opcode)
+                {
+                case ir_opcode::NONE:
+                    return fn(opcode_constant<ir_opcode::NONE>{});
+                case ir_opcode::IMM:
+                    return fn(opcode_constant<ir_opcode::IMM>{});
+                case ir_opcode::ADD:
+                    return fn(opcode_constant<ir_opcode::ADD>{});
+                case ir_opcode::SUB:
+                    return fn(opcode_constant<ir_opcode::SUB>{});
+                case ir_opcode::MUL:
+                    return fn(opcode_constant<ir_opcode::MUL>{});
+                case ir_opcode::UDIV:
+                    return fn(opcode_constant<ir_opcode::UDIV>{});
+                case ir_opcode::SDIV:
+                    return fn(opcode_constant<ir_opcode::SDIV>{});
+                case ir_opcode::SHL:
+                    return fn(opcode_constant<ir_opcode::SHL>{});
+                case ir_opcode::LSHR:
+                    return fn(opcode_constant<ir_opcode::LSHR>{});
+                case ir_opcode::ASHR:
+                    return fn(opcode_constant<ir_opcode::ASHR>{});
+                case ir_opcode::UMULH:
+                    return fn(opcode_constant<ir_opcode::UMULH>{});
+                case ir_opcode::MAX:
+                    break;
+                }
+
+                __builtin_unreachable();
+            }
+
+            template <ir_opcode Opc>
+            static auto select_for(ir_dag& ir_dag, ir_dag_node* ir_node, T& dag, node_type* target) -> bool
+            {
+                return (apply_rule_for<Opc, Rules>(ir_dag, ir_node, dag, target) || ... || false);
+            }
+
+            template <size_t I, typename Rule>
+            static void consider(ir_dag_node* ir_node, std::span<const size_t> costs, size_t& best, size_t& best_cost)
+            {
+                std::array<ir_dag_node*, Rule::match::_eat_size> args;
+                if (!Rule::match::template _fast_try<0>(ir_node, args))
+                {
+                    return;
+                }
+
+                leaf_list leaves;
+                if (ir_node->chain != nullptr)
+                {
+                    leaves.push_back(ir_node->chain);
+                }
+                Rule::match::_leaves(ir_node, leaves);
+
+                size_t cost = sbrt::isel::detail::rule_cost<Rule>;
+                for (auto* leaf : leaves)
+                {
+                    if (costs[leaf->get_id()] == std::numeric_limits<size_t>::max())
+                    {
+                        return;
+                    }
+                    cost += costs[leaf->get_id()];
+                }
+
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best = I;
+                }
+            }
+
+            template <ir_opcode Opc>
+            static auto best_rule_for(ir_dag_node* ir_node, std::span<const size_t> costs, size_t& best_cost) -> size_t
+            {
+                size_t best = NO_RULE;
+                best_cost = std::numeric_limits<size_t>::max();
+
+                [&]<size_t... I>(std::index_sequence<I...> /*unused*/) {
+                    (
+                        [&]() {
+                            if constexpr (Rules::match::OPC == Opc)
+                            {
+                                consider<I, Rules>(ir_node, costs, best, best_cost);
+                            }
+                        }(),
+                        ...
+                    );
+                }(std::index_sequence_for<Rules...>{});
+
+                return best;
+            }
+
+        public:
+            inline static auto select(ir_dag& ir_dag, ir_dag_node* ir_node, T& dag, node_type* target) -> bool
+            {
+                return on_opcode(ir_node->opcode, [&](auto opc) { return select_for<decltype(opc)::value>(ir_dag, ir_node, dag, target); });
+            }
+
+            /**
+             * Applies the rule at `index` in the flattened rule list
+             */
+            inline static void apply(size_t index, ir_dag& ir_dag, ir_dag_node* ir_node, T& dag, node_type* target)
+            {
+                [&]<size_t... I>(std::index_sequence<I...> /*unused*/) {
+                    ((index == I && (apply_rule<Rules>(ir_dag, ir_node, dag, target), true)) || ...);
+                }(std::index_sequence_for<Rules...>{});
+            }
+
+            /**
+             * Picks the cheapest matching rule for `ir_node`, given the best costs of everything below it. Ties go to
+             * the rule declared first. Returns NO_RULE if nothing matches.
+             */
+            inline static auto best_rule(ir_dag_node* ir_node, std::span<const size_t> costs, size_t& best_cost) -> size_t
+            {
+                return on_opcode(ir_node->opcode, [&](auto opc) { return best_rule_for<decltype(opc)::value>(ir_node, costs, best_cost); });
+            }
+
+            /**
+             * Lists the values the rule at `index` needs from other nodes when it covers `ir_node`
+             */
+            inline static void leaves(size_t index, ir_dag_node* ir_node, leaf_list& out)
+            {
+                if (ir_node->chain != nullptr)
+                {
+                    out.push_back(ir_node->chain);
+                }
+
+                [&]<size_t... I>(std::index_sequence<I...> /*unused*/) {
+                    ((index == I && (Rules::match::_leaves(ir_node, out), true)) || ...);
+                }(std::index_sequence_for<Rules...>{});
+            }
+        };
     } // namespace detail
 
+    enum class isel_mode
+    {
+        // first rule that matches a node wins, in declaration order
+        FIRST_MATCH,
+        // bottom-up dynamic programming over rule costs, and nodes absorbed by a pattern are not selected on their own
+        OPTIMAL
+    };
+
     template <typename T, typename Info>
     class generic_isel : public pass<ir_dag, T>
     {
         using node_type = T::node_type;
+        using dispatch = detail::rule_dispatch<T, typename detail::flatten_rules<typename Info::data>::type>;
+
+        isel_mode mode;
 
-        template <typename... Selectors>
-        static auto build_sel_table(pack<Selectors...> /*inst*/) -> auto
+        static void select_first_match(ir_dag& dag, T& new_dag)
         {
-            detail::sel_table_t<T> res;
-            (res + ... + detail::dummy<T, Selectors>{});
-            return res;
+            for (size_t i = 0; i < dag.max_node_id(); i++)
+            {
+                dispatch::select(dag, dag[i], new_dag, new_dag[i]);
+            }
         }
 
-        detail::sel_table_t<T> selector_table = build_sel_table(typename Info::data{});
+        static void select_optimal(ir_dag& dag, T& new_dag)
+        {
+            std::vector<size_t> costs(dag.max_node_id(), std::numeric_limits<size_t>::max());
+            std::vector<size_t> rules(dag.max_node_id(), dispatch::NO_RULE);
+
+            // operands come before their users in post order, so their best costs are final when a user is labelled
+            for (auto* node : dag.post_order())
+            {
+                rules[node->get_id()] = dispatch::best_rule(node, costs, costs[node->get_id()]);
+            }
+
+            // emit top-down, only the nodes some chosen pattern needs as a value
+            std::vector<bool> needed(dag.max_node_id());
+            std::vector<ir_dag_node*> worklist{dag.root()};
+            needed[dag.root()->get_id()] = true;
+            small_vector<ir_dag_node*, 4> leaves;
+
+            while (!worklist.empty())
+            {
+                auto* node = worklist.back();
+                worklist.pop_back();
+
+                size_t rule = rules[node->get_id()];
+                if (rule == dispatch::NO_RULE)
+                {
+                    continue;
+                }
+
+                dispatch::apply(rule, dag, node, new_dag, new_dag[node->get_id()]);
+
+                leaves.clear();
+                dispatch::leaves(rule, node, leaves);
+                for (auto* leaf : leaves)
+                {
+                    if (!needed[leaf->get_id()])
+                    {
+                        needed[leaf->get_id()] = true;
+                        worklist.push_back(leaf);
+                    }
+                }
+            }
+        }
 
     public:
+        generic_isel(isel_mode mode = isel_mode::FIRST_MATCH) : mode(mode) {}
+
         auto transform(ir_dag&& _dag) const -> pass<ir_dag, T>::result_t override
         {
             ir_dag dag = std::move(_dag);
             T new_dag;
+            new_dag.reserve(dag.max_node_id());
             for (size_t i = 0; i < dag.max_node_id(); i++)
             {
                 new_dag.create(nullptr, T::opcode_type::NONE, T::type_type::NONE);
             }
 
-            for (size_t i = 0; i < dag.max_node_id(); i++)
+            switch (mode)
             {
-                for (const auto& sel : selector_table[static_cast<uint64_t>(dag[i]->opcode)])
-                {
-                    ir_dag_node* node = dag[i];
-                    if (sel.match(node))
-                    {
-                        sel.invoke(dag, node, new_dag, new_dag[i]);
-                        break;
-                    }
-                }
+            case isel_mode::FIRST_MATCH:
+                select_first_match(dag, new_dag);
+                break;
+            case isel_mode::OPTIMAL:
+                select_optimal(dag, new_dag);
+                break;
             }
 
+            // rules write operand edges directly
+            new_dag.recompute_uses();
             new_dag.root(new_dag[dag.root()->get_id()]);
 
-            return std::move(new_dag);
+            if (mode == isel_mode::OPTIMAL)
+            {
+                // drop the placeholders of absorbed nodes
+                new_dag.erase_unreachable();
+            }
+
+            return new_dag;
         }
     };
 } // namespace sbrt::passes::isel
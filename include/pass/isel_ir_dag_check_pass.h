@@ -12,5 +12,13 @@ namespace sbrt::passes::isel
         [[nodiscard]] auto pass_name() const -> std::string override { return "cg::isel::dag_check"; }
 
         auto transform(ir::ir_dag&& _dag) const -> result_t override;
+
+        /**
+         * Validates the dense layout in place; only the type column is read
+         */
+        void check(const ir::ir_dense_dag& dag) const;
+
+    private:
+        void check_type(ir::ir_types type) const;
     };
 } // namespace sbrt::passes::isel
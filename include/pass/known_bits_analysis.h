@@ -0,0 +1,75 @@
+#pragma once
+
+#include "instr/ir.h"
+#include "pass/analysis.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace sbrt::passes::opt
+{
+    /**
+     * What is known about the value of a node, at the bit width of its type: bits known to be 0 and known to be 1, and
+     * inclusive unsigned and signed ranges. Every part is sound on its own, and the parts are kept consistent with each
+     * other. Types without a width are treated as 64-bit.
+     */
+    struct value_facts
+    {
+        uint64_t known_zero;
+        uint64_t known_one;
+        uint64_t umin;
+        uint64_t umax;
+        int64_t smin;
+        int64_t smax;
+
+        static auto unknown(size_t bits) -> value_facts;
+        static auto constant(uint64_t value, size_t bits) -> value_facts;
+
+        [[nodiscard]] auto is_constant() const -> bool { return umin == umax; }
+        [[nodiscard]] auto known_mask() const -> uint64_t { return known_zero | known_one; }
+
+        auto operator==(const value_facts&) const -> bool = default;
+    };
+
+    /**
+     * Known bits and value ranges of every node of an ir_dag, from IMMs through the arithmetic opcodes.
+     *
+     * Facts are computed for the whole dag up front; nodes created later are computed on first use. A pass that keeps
+     * the analysis preserved while rewriting calls update() on each node it changed in place, or update_users() on the
+     * node that replace_all_uses_with() redirected to. Only the cone above those nodes is recomputed, each node at most
+     * once and in topological order, so batching the changed nodes into a single update() is cheapest; defer() and
+     * defer_users() queue them into scratch owned by the analysis, and flush() updates everything queued. Ids are used
+     * as keys, so the analysis does not survive id compaction.
+     */
+    class known_bits_analysis
+    {
+        std::vector<value_facts> facts;
+        std::vector<bool> computed;
+        // scratch for the operand walk, and for collecting the cone an update touches
+        std::vector<ir::ir_dag_node*> stack;
+        std::vector<std::pair<ir::ir_dag_node*, size_t>> walk;
+        std::vector<ir::ir_dag_node*> cone;
+        std::vector<bool> in_cone;
+        std::vector<bool> dirty;
+        std::vector<ir::ir_dag_node*> deferred;
+
+        void compute(ir::ir_dag_node* node);
+        void ensure(ir::ir_dag_node* node);
+        auto recompute(ir::ir_dag_node* node) -> bool;
+
+    public:
+        known_bits_analysis(ir::ir_dag& dag, analysis_manager<ir::ir_dag>& analyses);
+
+        auto of(ir::ir_dag_node* node) -> const value_facts&;
+
+        void update(ir::ir_dag_node* node);
+        void update(std::span<ir::ir_dag_node* const> nodes);
+        void update_users(ir::ir_dag_node* node);
+
+        void defer(ir::ir_dag_node* node) { deferred.push_back(node); }
+        void defer_users(ir::ir_dag_node* node) { deferred.insert(deferred.end(), node->get_users().begin(), node->get_users().end()); }
+        void flush();
+    };
+} // namespace sbrt::passes::opt
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "instr/ir.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <variant>
+
+namespace sbrt::passes::opt
+{
+    inline constexpr auto width_mask(size_t bits) -> uint64_t { return bits >= 64 ? UINT64_MAX : (uint64_t{1} << bits) - 1; }
+
+    inline constexpr auto sign_extend(uint64_t value, size_t bits) -> int64_t
+    {
+        return static_cast<int64_t>(value << (64 - bits)) >> (64 - bits);
+    }
+
+    /**
+     * Value of `opcode` applied to constants, truncated to `bits`; nothing where the operation traps or is undefined
+     * (division by zero, INT_MIN / -1, shifts by the width or more) and for opcodes that are not binary arithmetic
+     */
+    auto evaluate(ir::ir_opcode opcode, uint64_t lhs, uint64_t rhs, size_t bits) -> std::optional<uint64_t>;
+
+    /**
+     * Value of an IMM node truncated to its type, or nothing for any other node
+     */
+    inline auto constant_of(const ir::ir_dag_node* node) -> std::optional<uint64_t>
+    {
+        if (node->opcode != ir::ir_opcode::IMM || node->imm.size() != 1 || node->type.bit_width() == 0)
+        {
+            return std::nullopt;
+        }
+
+        return std::get<uint64_t>(node->imm[0]) & width_mask(node->type.bit_width());
+    }
+
+    /**
+     * Turns `node` into an IMM of `value` in place, keeping its users and its type; the operands lose a use each
+     */
+    inline void make_constant(ir::ir_dag& dag, ir::ir_dag_node* node, uint64_t value)
+    {
+        dag.clear_operands(node);
+        dag.unhash_node(node);
+        node->opcode = ir::ir_opcode::IMM;
+        node->imm.clear();
+        node->imm.emplace_back(value & width_mask(node->type.bit_width()));
+        dag.rehash_node(node);
+    }
+} // namespace sbrt::passes::opt
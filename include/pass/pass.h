@@ -2,6 +2,9 @@
 
 #include "common.h"
 #include "instr/ir.h"
+#include "pass/analysis.h"
+#include "pass/pass_statistics.h"
+#include <chrono>
 #include <expected.h>
 #include <memory>
 #include <string>
@@ -20,9 +23,41 @@ namespace sbrt
 
         [[nodiscard]] virtual auto transform(T&& dag) const -> result_t = 0;
 
+        /**
+         * Runs the pass with the analyses a pipeline has cached for `dag`. Passes that use analyses derive from
+         * analysis_pass, everything else ignores them.
+         */
+        [[nodiscard]] virtual auto transform_with(T&& dag, analysis_manager<T>& /*analyses*/) const -> result_t
+        {
+            return transform(std::move(dag));
+        }
+
+        /**
+         * Analyses still valid after a successful run, whatever the pass did to the dag
+         */
+        [[nodiscard]] virtual auto preserved() const -> preserved_analyses { return preserved_analyses::none(); }
+
         virtual ~pass() = default;
     };
 
+    /**
+     * Base for passes that request analyses; run on their own they start from an empty cache
+     */
+    template <typename T, typename U>
+    class analysis_pass : public pass<T, U>
+    {
+    public:
+        using result_t = pass<T, U>::result_t;
+
+        auto transform(T&& dag) const -> result_t final
+        {
+            analysis_manager<T> analyses;
+            return transform_with(std::move(dag), analyses);
+        }
+
+        auto transform_with(T&& dag, analysis_manager<T>& analyses) const -> result_t override = 0;
+    };
+
     template <typename T, typename U>
     using pass_ref = std::unique_ptr<pass<T, U>>;
 
@@ -33,42 +68,127 @@ namespace sbrt
     using transformer_ref = pass_ref<T, T>;
 
     template <typename T>
-    class pipeline final : public transformer<T>
+    class pipeline final : public analysis_pass<T, T>
     {
         std::vector<transformer_ref<T>> passes;
+        pass_statistics* statistics = nullptr;
+        // taken once when instrumenting, pass_name() builds a new string every call
+        std::vector<std::string> names;
+
+        auto run_instrumented(T&& dag, analysis_manager<T>& analyses) const -> transformer<T>::result_t
+        {
+            T instance = std::move(dag);
+            for (size_t i = 0; i < passes.size(); i++)
+            {
+                pass_sample sample{.before = dag_footprint::of(instance), .failed = true};
+                auto wall_start = std::chrono::steady_clock::now();
+                auto cpu_start = pass_statistics::thread_cpu_time();
+
+                auto record = [&]() {
+                    sample.wall = std::chrono::steady_clock::now() - wall_start;
+                    sample.cpu = pass_statistics::thread_cpu_time() - cpu_start;
+                    statistics->record(names[i], sample);
+                };
+
+                auto temp = [&]() {
+                    try
+                    {
+                        return passes[i]->transform_with(std::move(instance), analyses);
+                    }
+                    catch (...)
+                    {
+                        // a thrown error is a failed run as much as a returned one
+                        record();
+                        throw;
+                    }
+                }();
+
+                if (temp)
+                {
+                    sample.after = dag_footprint::of(*temp);
+                    sample.failed = false;
+                }
+                record();
+
+                if (!temp)
+                {
+                    return temp;
+                }
+
+                instance = std::move(*temp);
+                if (!analyses.empty())
+                {
+                    analyses.invalidate(passes[i]->preserved());
+                }
+            }
+
+            return instance;
+        }
 
     public:
         pipeline(std::vector<transformer_ref<T>> passes) : passes(std::move(passes)) {}
 
+        /**
+         * Records every pass run into `stats` from now on, or stops recording if it is null. Not synchronized with
+         * transform(), so set it up before the pipeline is shared.
+         */
+        void instrument(pass_statistics* stats)
+        {
+            statistics = stats;
+            names.clear();
+            if (stats != nullptr)
+            {
+                for (const auto& pass : passes)
+                {
+                    names.push_back(pass->pass_name());
+                }
+            }
+        }
+
         [[nodiscard]] auto pass_name() const -> std::string override
         {
             std::string result = "pipeline(";
             for (const auto& pass : passes)
             {
-                result += pass.pass_name() + " ";
+                result += pass->pass_name() + " ";
             }
             result.pop_back();
             result.push_back(')');
             return result;
         }
 
-        auto transform(T&& dag) const -> transformer<T>::result_t override
+        /**
+         * Runs the passes in order over one cache of analyses, shared with the enclosing pipeline if there is one
+         */
+        auto transform_with(T&& dag, analysis_manager<T>& analyses) const -> transformer<T>::result_t override
         {
+            if (statistics != nullptr)
+            {
+                return run_instrumented(std::move(dag), analyses);
+            }
+
             T instance = std::move(dag);
             for (const auto& pass : passes)
             {
-                auto temp = pass->transform();
+                auto temp = pass->transform_with(std::move(instance), analyses);
                 if (!temp)
                 {
                     return temp;
                 }
 
-                instance = std::move(temp);
+                instance = std::move(*temp);
+                if (!analyses.empty())
+                {
+                    analyses.invalidate(pass->preserved());
+                }
             }
 
             return instance;
         }
 
+        // every pass already invalidated what it had to in the shared cache
+        [[nodiscard]] auto preserved() const -> preserved_analyses override { return preserved_analyses::all(); }
+
         ~pipeline() override = default;
     };
 
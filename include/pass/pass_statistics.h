@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sbrt
+{
+    /**
+     * Size of a dag as seen by the statistics, for anything with max_node_id() and allocated_bytes(). `dag_bytes` is
+     * what the dag itself holds in its arena and node tables; scratch a pass allocates on the side is not counted.
+     */
+    struct dag_footprint
+    {
+        size_t nodes = 0;
+        size_t dag_bytes = 0;
+
+        template <typename T>
+        static auto of(const T& dag) -> dag_footprint
+        {
+            if constexpr (requires {
+                              dag.max_node_id();
+                              dag.allocated_bytes();
+                          })
+            {
+                return {dag.max_node_id(), dag.allocated_bytes()};
+            }
+            else
+            {
+                return {};
+            }
+        }
+    };
+
+    /**
+     * One run of one pass
+     */
+    struct pass_sample
+    {
+        std::chrono::nanoseconds wall{};
+        std::chrono::nanoseconds cpu{};
+        dag_footprint before{};
+        dag_footprint after{};
+        bool failed = false;
+    };
+
+    /**
+     * Per-pass totals across runs, keyed by pass name. Samples may be recorded from several threads at once, such as
+     * the workers of a batch pipeline; CPU time is that of the thread running the pass.
+     */
+    class pass_statistics
+    {
+    public:
+        struct entry
+        {
+            std::string name;
+            uint64_t runs = 0;
+            uint64_t failures = 0;
+            std::chrono::nanoseconds wall{};
+            std::chrono::nanoseconds cpu{};
+            // sums over the successful runs
+            uint64_t nodes_before = 0;
+            uint64_t nodes_after = 0;
+            uint64_t dag_bytes_before = 0;
+            uint64_t dag_bytes_after = 0;
+        };
+
+    private:
+        mutable std::mutex mutex;
+        std::vector<entry> entries;
+
+    public:
+        /**
+         * CPU time consumed by the calling thread so far
+         */
+        static auto thread_cpu_time() -> std::chrono::nanoseconds;
+
+        void record(std::string_view name, const pass_sample& sample);
+
+        /**
+         * Copy of the totals, in the order passes were first seen
+         */
+        [[nodiscard]] auto snapshot() const -> std::vector<entry>;
+        void clear();
+
+        void dump_table(std::ostream& out) const;
+        void dump_json(std::ostream& out) const;
+    };
+} // namespace sbrt
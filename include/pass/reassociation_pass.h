@@ -0,0 +1,29 @@
+#pragma once
+
+#include "instr/ir.h"
+#include "pass/pass.h"
+#include <cstddef>
+#include <string>
+
+namespace sbrt::passes::opt
+{
+    /**
+     * Rewrites trees of ADD, SUB and MUL by constants into a canonical linear form, sum(c_i * x_i) + k, with one
+     * term per distinct leaf (ordered by node id, subtracted terms last) and all constants combined into k. Everything
+     * is computed modulo 2^width, where this is exact. A coefficient of 2 is built as x + x and -1 as a subtraction, so
+     * only other coefficients take a MUL, and a tree never gets more MULs than it had. Subtrees with more than one use
+     * stay leaves, so nothing is duplicated, and a tree is only rebuilt when the result weighs no more than it does, a
+     * MUL counting as three ADDs; at equal weight it is rebuilt only if it is not canonical yet. Rewrites free up nodes
+     * for the trees above them, so the walk repeats until nothing changes, for a few rounds at most. The old nodes are
+     * left for dce.
+     */
+    class reassociation final : public transformer<ir::ir_dag>
+    {
+        inline static constexpr size_t MAX_ROUNDS = 4;
+
+    public:
+        [[nodiscard]] auto pass_name() const -> std::string override { return "opt::reassociate"; }
+
+        auto transform(ir::ir_dag&& _dag) const -> result_t override;
+    };
+} // namespace sbrt::passes::opt
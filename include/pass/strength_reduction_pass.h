@@ -0,0 +1,42 @@
+#pragma once
+
+#include "instr/ir.h"
+#include "pass/pass.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace sbrt::passes::opt
+{
+    /**
+     * Multiplier and shift that turn an unsigned division by a constant into a multiply-high: the quotient is
+     * `umulh(x, multiplier) >> shift`, or with `add` set, `(t + ((x - t) >> 1)) >> shift` where t = umulh(x, multiplier).
+     */
+    struct unsigned_magic
+    {
+        uint64_t multiplier;
+        size_t shift;
+        bool add;
+    };
+
+    /**
+     * Magic numbers for dividing `bits`-wide values by `divisor`, which is at least 2 and not a power of two
+     */
+    auto unsigned_magic_for(uint64_t divisor, size_t bits) -> unsigned_magic;
+
+    /**
+     * Rewrites multiplications and divisions by constants into cheaper sequences, exact at the width of the type:
+     * - MUL by 2^k, 2^k+1, 2^k-1, 2^a+2^b and -1 into shifts, adds and subtractions
+     * - UDIV by 2^k into a shift, and by any other constant into UMULH with shifts
+     * - SDIV by +-2^k into a rounding bias and an arithmetic shift, negated for negative divisors
+     * The constant may be either operand of MUL. Run constant folding first, multiplications and divisions by 0 and 1
+     * are left to it.
+     */
+    class strength_reduction final : public transformer<ir::ir_dag>
+    {
+    public:
+        [[nodiscard]] auto pass_name() const -> std::string override { return "opt::strength_reduce"; }
+
+        auto transform(ir::ir_dag&& _dag) const -> result_t override;
+    };
+} // namespace sbrt::passes::opt
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace sbrt
+{
+    /**
+     * Vector that keeps up to N elements inline, and only goes to the heap once it grows past that
+     */
+    template <typename T, size_t N>
+    class small_vector
+    {
+        static_assert(N > 0, "small_vector needs at least one inline slot");
+
+        T* ptr;
+        uint32_t len = 0;
+        uint32_t cap = N;
+        alignas(T) std::byte inline_storage[N * sizeof(T)];
+
+        [[nodiscard]] constexpr auto inline_data() -> T* { return std::launder(reinterpret_cast<T*>(inline_storage)); }
+        [[nodiscard]] constexpr auto is_inline() const -> bool { return cap == N; }
+
+        void grow(size_t min_cap)
+        {
+            auto new_cap = static_cast<uint32_t>(std::max<size_t>(min_cap, cap * 2));
+            T* new_data = std::allocator<T>{}.allocate(new_cap);
+            std::uninitialized_move_n(ptr, len, new_data);
+            std::destroy_n(ptr, len);
+            release();
+            ptr = new_data;
+            cap = new_cap;
+        }
+
+        void release()
+        {
+            if (!is_inline())
+            {
+                std::allocator<T>{}.deallocate(ptr, cap);
+            }
+        }
+
+        void take(small_vector&& other)
+        {
+            if (other.is_inline())
+            {
+                ptr = inline_data();
+                cap = N;
+                std::uninitialized_move_n(other.ptr, other.len, ptr);
+                len = other.len;
+                other.clear();
+            }
+            else
+            {
+                ptr = std::exchange(other.ptr, other.inline_data());
+                cap = std::exchange(other.cap, N);
+                len = std::exchange(other.len, 0);
+            }
+        }
+
+    public:
+        using value_type = T;
+        using size_type = size_t;
+        using iterator = T*;
+        using const_iterator = const T*;
+
+        small_vector() : ptr(inline_data()) {}
+
+        small_vector(std::initializer_list<T> init) : small_vector()
+        {
+            reserve(init.size());
+            for (const auto& value : init)
+            {
+                push_back(value);
+            }
+        }
+
+        small_vector(const small_vector& other) : small_vector()
+        {
+            reserve(other.size());
+            std::uninitialized_copy_n(other.ptr, other.len, ptr);
+            len = other.len;
+        }
+
+        small_vector(small_vector&& other) noexcept(std::is_nothrow_move_constructible_v<T>) { take(std::move(other)); }
+
+        auto operator=(const small_vector& other) -> small_vector&
+        {
+            if (this != &other)
+            {
+                clear();
+                reserve(other.size());
+                std::uninitialized_copy_n(other.ptr, other.len, ptr);
+                len = other.len;
+            }
+            return *this;
+        }
+
+        auto operator=(small_vector&& other) noexcept(std::is_nothrow_move_constructible_v<T>) -> small_vector&
+        {
+            if (this != &other)
+            {
+                clear();
+                release();
+                take(std::move(other));
+            }
+            return *this;
+        }
+
+        ~small_vector()
+        {
+            clear();
+            release();
+        }
+
+        void reserve(size_t new_cap)
+        {
+            if (new_cap > cap)
+            {
+                grow(new_cap);
+            }
+        }
+
+        template <typename... Args>
+        auto emplace_back(Args&&... args) -> T&
+        {
+            if (len == cap)
+            {
+                grow(len + 1);
+            }
+
+            return *std::construct_at(ptr + len++, std::forward<Args>(args)...);
+        }
+
+        void push_back(const T& value) { emplace_back(value); }
+        void push_back(T&& value) { emplace_back(std::move(value)); }
+
+        void pop_back() { std::destroy_at(ptr + --len); }
+
+        auto erase(iterator pos) -> iterator
+        {
+            std::move(pos + 1, end(), pos);
+            pop_back();
+            return pos;
+        }
+
+        void clear()
+        {
+            std::destroy_n(ptr, len);
+            len = 0;
+        }
+
+        [[nodiscard]] constexpr auto size() const -> size_t { return len; }
+        [[nodiscard]] constexpr auto capacity() const -> size_t { return cap; }
+        [[nodiscard]] constexpr auto empty() const -> bool { return len == 0; }
+        [[nodiscard]] constexpr auto data() -> T* { return ptr; }
+        [[nodiscard]] constexpr auto data() const -> const T* { return ptr; }
+
+        constexpr auto operator[](size_t index) -> T& { return ptr[index]; }
+        constexpr auto operator[](size_t index) const -> const T& { return ptr[index]; }
+        constexpr auto front() -> T& { return ptr[0]; }
+        constexpr auto back() -> T& { return ptr[len - 1]; }
+
+        constexpr auto begin() -> iterator { return ptr; }
+        constexpr auto end() -> iterator { return ptr + len; }
+        constexpr auto begin() const -> const_iterator { return ptr; }
+        constexpr auto end() const -> const_iterator { return ptr + len; }
+    };
+} // namespace sbrt
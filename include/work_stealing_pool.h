@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sbrt
+{
+    /**
+     * Persistent thread pool for data parallel loops. Each participant (the workers plus the calling thread) starts with
+     * an equal slice of the index range, takes indices off the front of its own slice, and once that is empty steals the
+     * back half of the largest slice left. Slices are single 64-bit words updated with CAS, so nothing is locked while
+     * the loop runs.
+     */
+    class work_stealing_pool
+    {
+        struct alignas(64) slice
+        {
+            // begin in the high half, end in the low half
+            std::atomic<uint64_t> range = 0;
+        };
+
+        std::unique_ptr<slice[]> slices;
+        size_t participants;
+
+        std::mutex mutex;
+        std::condition_variable start;
+        std::condition_variable finished;
+        uint64_t generation = 0;
+        size_t running = 0;
+        bool stopping = false;
+        const std::function<void(size_t)>* body = nullptr;
+        // first exception thrown by `body` during the current loop
+        std::exception_ptr thrown;
+
+        std::vector<std::jthread> workers;
+
+        static constexpr auto pack(uint64_t begin, uint64_t end) -> uint64_t { return (begin << 32) | end; }
+
+        auto pop(size_t self, size_t& index) -> bool;
+        auto steal(size_t self) -> bool;
+        void participate(size_t self);
+        void work(size_t self);
+
+    public:
+        /**
+         * `threads` workers on top of the thread calling parallel_for
+         */
+        explicit work_stealing_pool(size_t threads = std::max(1U, std::thread::hardware_concurrency()) - 1);
+        work_stealing_pool(const work_stealing_pool&) = delete;
+        auto operator=(const work_stealing_pool&) -> work_stealing_pool& = delete;
+        ~work_stealing_pool();
+
+        /**
+         * Calls `fn(i)` for every i in [0, count), spread over the pool, and returns once all calls did. If any call
+         * throws, the other calls still run and the first exception is rethrown here. Only one parallel_for may run at
+         * a time.
+         */
+        void parallel_for(size_t count, const std::function<void(size_t)>& fn);
+
+        [[nodiscard]] auto size() const -> size_t { return participants; }
+    };
+} // namespace sbrt
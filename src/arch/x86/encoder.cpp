@@ -0,0 +1,524 @@
+#include "arch/x86/encoder.h"
+#include "arch/x86/instr.h"
+#include "arch/x86/regalloc.h"
+#include "cast.h"
+#include "common.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/core.h>
+#include <magic_enum.hpp>
+#include <ranges>
+
+namespace sbrt::x86
+{
+    namespace
+    {
+        enum class form
+        {
+            NONE,
+            RR,
+            RI,
+            MOV_IMM,
+            SHIFT,
+            MUL_HIGH
+        };
+
+        struct opcode_encoding
+        {
+            form kind;
+            // opcode of the `op r/m, r` form, for RR
+            uint8_t rr_opcode;
+            // /digit of the 0x81/0x83 immediate group for RI, of the 0xc1 shift group for SHIFT
+            uint8_t digit;
+            bool commutative;
+        };
+
+        constexpr auto build_encoding_table()
+        {
+            std::array<opcode_encoding, static_cast<size_t>(mc_x86_opcode::MAX)> table{};
+            auto set = [&table](mc_x86_opcode opcode, opcode_encoding encoding) { table[static_cast<size_t>(opcode)] = encoding; };
+
+            set(mc_x86_opcode::ADD_ri, {form::RI, 0, 0, true});
+            set(mc_x86_opcode::ADD_rr, {form::RR, 0x01, 0, true});
+            set(mc_x86_opcode::SUB_ri, {form::RI, 0, 5, false});
+            set(mc_x86_opcode::SUB_rr, {form::RR, 0x29, 5, false});
+            set(mc_x86_opcode::MOV_ri, {form::MOV_IMM, 0, 0, false});
+            set(mc_x86_opcode::SHL_ri, {form::SHIFT, 0, 4, false});
+            set(mc_x86_opcode::SHR_ri, {form::SHIFT, 0, 5, false});
+            set(mc_x86_opcode::SAR_ri, {form::SHIFT, 0, 7, false});
+            set(mc_x86_opcode::UMULH_rr, {form::MUL_HIGH, 0, 0, true});
+            return table;
+        }
+
+        constexpr auto ENCODINGS = build_encoding_table();
+
+        constexpr auto reg_bits(gpr reg) -> uint8_t { return static_cast<uint8_t>(reg); }
+        constexpr auto is_wide(mc_x86_types type) -> bool { return type == mc_x86_types::U64; }
+
+        constexpr auto bit_width(mc_x86_types type) -> uint8_t
+        {
+            switch (type)
+            {
+            case mc_x86_types::U8:
+                return 8;
+            case mc_x86_types::U16:
+                return 16;
+            case mc_x86_types::U32:
+                return 32;
+            default:
+                return 64;
+            }
+        }
+
+        constexpr auto width_mask(mc_x86_types type) -> uint64_t
+        {
+            switch (type)
+            {
+            case mc_x86_types::U8:
+                return 0xff;
+            case mc_x86_types::U16:
+                return 0xffff;
+            case mc_x86_types::U32:
+                return 0xffffffff;
+            default:
+                return ~0ULL;
+            }
+        }
+
+        /**
+         * Sign extends the low bits of `value` for a narrow type, since only those bits of the result matter
+         */
+        constexpr auto sign_extend(uint64_t value, mc_x86_types type) -> int64_t
+        {
+            switch (type)
+            {
+            case mc_x86_types::U8:
+                return static_cast<int8_t>(value);
+            case mc_x86_types::U16:
+                return static_cast<int16_t>(value);
+            case mc_x86_types::U32:
+                return static_cast<int32_t>(value);
+            default:
+                return static_cast<int64_t>(value);
+            }
+        }
+
+        constexpr auto fits_i8(int64_t value) -> bool { return value >= INT8_MIN && value <= INT8_MAX; }
+        constexpr auto fits_i32(int64_t value) -> bool { return value >= INT32_MIN && value <= INT32_MAX; }
+    } // namespace
+
+    void x86_emitter::rex(bool wide, uint8_t reg, uint8_t rm)
+    {
+        uint8_t prefix = 0x40 | (wide ? 0x08 : 0) | ((reg & 8) != 0 ? 0x04 : 0) | ((rm & 8) != 0 ? 0x01 : 0);
+        if (prefix != 0x40)
+        {
+            byte(prefix);
+        }
+    }
+
+    void x86_emitter::modrm_rr(uint8_t reg, uint8_t rm) { byte(0xc0 | ((reg & 7) << 3) | (rm & 7)); }
+
+    void x86_emitter::modrm_mem(uint8_t reg, gpr base, int32_t disp)
+    {
+        uint8_t rm = reg_bits(base) & 7;
+        // [rbp]/[r13] have no disp-less form, the encoding is taken by rip-relative addressing
+        bool no_disp = disp == 0 && rm != 5;
+        bool short_disp = fits_i8(disp);
+
+        byte((no_disp ? 0x00 : short_disp ? 0x40 : 0x80) | ((reg & 7) << 3) | rm);
+        if (rm == 4)
+        {
+            // rsp/r12 as base need a SIB byte
+            byte(0x24);
+        }
+
+        if (!no_disp)
+        {
+            imm(static_cast<uint32_t>(disp), short_disp ? 1 : 4);
+        }
+    }
+
+    void x86_emitter::imm(uint64_t value, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            byte(static_cast<uint8_t>(value >> (i * 8)));
+        }
+    }
+
+    void x86_emitter::align(size_t alignment, size_t bias)
+    {
+        while ((pos + bias) % alignment != 0)
+        {
+            byte(0x90);
+        }
+    }
+
+    void x86_emitter::mov_rr(mc_x86_types type, gpr dst, gpr src)
+    {
+        if (dst == src)
+        {
+            return;
+        }
+
+        // mov r/m, r
+        rex(is_wide(type), reg_bits(src), reg_bits(dst));
+        byte(0x89);
+        modrm_rr(reg_bits(src), reg_bits(dst));
+    }
+
+    void x86_emitter::mov_ri(mc_x86_types type, gpr dst, uint64_t value)
+    {
+        value &= width_mask(type);
+
+        if (value <= UINT32_MAX)
+        {
+            // mov r32, imm32, zero extends into the full register
+            rex(false, 0, reg_bits(dst));
+            byte(0xb8 + (reg_bits(dst) & 7));
+            imm(value, 4);
+        }
+        else if (fits_i32(static_cast<int64_t>(value)))
+        {
+            // mov r/m64, imm32 (sign extended)
+            rex(true, 0, reg_bits(dst));
+            byte(0xc7);
+            modrm_rr(0, reg_bits(dst));
+            imm(value, 4);
+        }
+        else
+        {
+            // movabs r64, imm64
+            rex(true, 0, reg_bits(dst));
+            byte(0xb8 + (reg_bits(dst) & 7));
+            imm(value, 8);
+        }
+    }
+
+    void x86_emitter::mov_rm(gpr dst, gpr base, int32_t disp)
+    {
+        rex(true, reg_bits(dst), reg_bits(base));
+        byte(0x8b);
+        modrm_mem(reg_bits(dst), base, disp);
+    }
+
+    void x86_emitter::mov_mr(gpr base, int32_t disp, gpr src)
+    {
+        rex(true, reg_bits(src), reg_bits(base));
+        byte(0x89);
+        modrm_mem(reg_bits(src), base, disp);
+    }
+
+    void x86_emitter::alu_rr(uint8_t opcode, mc_x86_types type, gpr dst, gpr src)
+    {
+        rex(is_wide(type), reg_bits(src), reg_bits(dst));
+        byte(opcode);
+        modrm_rr(reg_bits(src), reg_bits(dst));
+    }
+
+    void x86_emitter::alu_ri(uint8_t digit, mc_x86_types type, gpr dst, uint64_t value)
+    {
+        int64_t extended = sign_extend(value, type);
+
+        if (is_wide(type) && !fits_i32(extended))
+        {
+            // no 64-bit immediate form, go through the scratch register
+            mov_ri(type, SCRATCH_REGISTER, value);
+            alu_rr(static_cast<uint8_t>((digit << 3) | 0x01), type, dst, SCRATCH_REGISTER);
+            return;
+        }
+
+        rex(is_wide(type), 0, reg_bits(dst));
+        if (fits_i8(extended))
+        {
+            byte(0x83);
+            modrm_rr(digit, reg_bits(dst));
+            imm(static_cast<uint64_t>(extended), 1);
+        }
+        else
+        {
+            byte(0x81);
+            modrm_rr(digit, reg_bits(dst));
+            imm(static_cast<uint64_t>(extended), 4);
+        }
+    }
+
+    void x86_emitter::neg(mc_x86_types type, gpr reg)
+    {
+        rex(is_wide(type), 0, reg_bits(reg));
+        byte(0xf7);
+        modrm_rr(3, reg_bits(reg));
+    }
+
+    void x86_emitter::shift_ri(uint8_t digit, mc_x86_types type, gpr reg, uint8_t amount)
+    {
+        rex(is_wide(type), 0, reg_bits(reg));
+        byte(0xc1);
+        modrm_rr(digit, reg_bits(reg));
+        byte(amount);
+    }
+
+    void x86_emitter::extend(mc_x86_types type, gpr dst, gpr src, bool sign)
+    {
+        switch (type)
+        {
+        case mc_x86_types::U8:
+        case mc_x86_types::U16: {
+            // movzx/movsx r32, r/m8 or r/m16; a byte source always takes a rex prefix, without one spl..dil would
+            // read as ah..bh
+            uint8_t prefix = 0x40 | ((reg_bits(dst) & 8) != 0 ? 0x04 : 0) | ((reg_bits(src) & 8) != 0 ? 0x01 : 0);
+            if (prefix != 0x40 || type == mc_x86_types::U8)
+            {
+                byte(prefix);
+            }
+            byte(0x0f);
+            byte((sign ? 0xbe : 0xb6) | (type == mc_x86_types::U16 ? 1 : 0));
+            modrm_rr(reg_bits(dst), reg_bits(src));
+            break;
+        }
+        case mc_x86_types::U32:
+            if (sign)
+            {
+                // movsxd r64, r/m32
+                rex(true, reg_bits(dst), reg_bits(src));
+                byte(0x63);
+                modrm_rr(reg_bits(dst), reg_bits(src));
+            }
+            else
+            {
+                // mov r32, r32 clears the upper half
+                rex(false, reg_bits(src), reg_bits(dst));
+                byte(0x89);
+                modrm_rr(reg_bits(src), reg_bits(dst));
+            }
+            break;
+        default:
+            mov_rr(type, dst, src);
+            break;
+        }
+    }
+
+    void x86_emitter::mul(mc_x86_types type, gpr reg)
+    {
+        rex(is_wide(type), 0, reg_bits(reg));
+        byte(0xf7);
+        modrm_rr(4, reg_bits(reg));
+    }
+
+    void x86_emitter::imul_rr(mc_x86_types type, gpr dst, gpr src)
+    {
+        rex(is_wide(type), reg_bits(dst), reg_bits(src));
+        byte(0x0f);
+        byte(0xaf);
+        modrm_rr(reg_bits(dst), reg_bits(src));
+    }
+
+    void x86_emitter::dec_m(gpr base, int32_t disp)
+    {
+        rex(true, 0, reg_bits(base));
+        byte(0xff);
+        modrm_mem(1, base, disp);
+    }
+
+    void x86_emitter::lea_buffer(gpr dst, size_t offset)
+    {
+        // lea r64, [rip + disp32], where rip is the end of the 7 byte instruction
+        auto disp = static_cast<int64_t>(offset) - static_cast<int64_t>(pos + 7);
+        rex(true, reg_bits(dst), 0);
+        byte(0x8d);
+        byte(0x05 | ((reg_bits(dst) & 7) << 3));
+        imm(static_cast<uint64_t>(disp), 4);
+    }
+
+    void x86_emitter::push(gpr reg)
+    {
+        rex(false, 0, reg_bits(reg));
+        byte(0x50 + (reg_bits(reg) & 7));
+    }
+
+    void x86_emitter::pop(gpr reg)
+    {
+        rex(false, 0, reg_bits(reg));
+        byte(0x58 + (reg_bits(reg) & 7));
+    }
+
+    auto max_encoded_size(const register_assignment& assignment) -> size_t
+    {
+        // counter prologue, frame and exit sequence are below 80 bytes, saving and restoring a callee-saved register takes at
+        // most 4, one node at most 24 (the 64-bit multiply high sequence) and a spill move at most 8
+        return 80 + assignment.callee_saved.size() * 4 + assignment.order.size() * 24 + assignment.moves.size() * 8;
+    }
+
+    auto encode_block(const register_assignment& assignment, u8_slice out, const encode_options& options) -> tl::expected<encoded_block, error>
+    {
+        x86_emitter emitter(out);
+        auto frame_size = static_cast<int32_t>(assignment.spill_slots * 8);
+
+        if (options.entry_counter != nullptr)
+        {
+            emitter.mov_ri(mc_x86_types::U64, SCRATCH_REGISTER, as_uptr(options.entry_counter));
+            emitter.dec_m(SCRATCH_REGISTER, 0);
+            auto body = emitter.jnz_short();
+            emitter.mov_ri(mc_x86_types::U64, gpr::RAX, options.guest_pc);
+            emitter.lea_buffer(gpr::RDX, block_exit::HOT);
+            emitter.ret();
+            emitter.bind(body);
+        }
+
+        // after the counter, so a hot exit has nothing to restore
+        for (auto reg : assignment.callee_saved)
+        {
+            emitter.push(reg);
+        }
+
+        if (frame_size != 0)
+        {
+            emitter.alu_ri(5, mc_x86_types::U64, gpr::RSP, frame_size);
+        }
+
+        for (size_t position = 0; position < assignment.order.size(); position++)
+        {
+            for (const auto& move : assignment.moves_before(position))
+            {
+                auto disp = static_cast<int32_t>(move.slot * 8);
+                if (move.reload)
+                {
+                    emitter.mov_rm(move.reg, gpr::RSP, disp);
+                }
+                else
+                {
+                    emitter.mov_mr(gpr::RSP, disp, move.reg);
+                }
+            }
+
+            auto* node = assignment.order[position];
+            const auto& encoding = ENCODINGS[static_cast<size_t>(node->opcode)];
+            auto operands = assignment.operand_regs(position);
+            gpr dst = assignment.defs[position];
+
+            if (encoding.kind != form::NONE && node->type == mc_x86_types::NONE)
+            {
+                // the operand size would be guessed, and a pointer silently truncated to 32 bits
+                return tl::unexpected(error(
+                    fmt::format("cannot encode untyped x86 {}", magic_enum::enum_name(node->opcode)), submodule::LOWER
+                ));
+            }
+
+            switch (encoding.kind)
+            {
+            case form::NONE:
+                return tl::unexpected(error(
+                    fmt::format("cannot encode x86 opcode {}", magic_enum::enum_name(node->opcode)), submodule::LOWER
+                ));
+            case form::MOV_IMM:
+                emitter.mov_ri(node->type, dst, std::get<uint64_t>(node->imm[0]));
+                break;
+            case form::RI: {
+                gpr src = operands[0];
+                emitter.mov_rr(node->type, dst, src);
+                emitter.alu_ri(encoding.digit, node->type, dst, std::get<uint64_t>(node->imm[0]));
+                break;
+            }
+            case form::RR: {
+                gpr lhs = operands[0];
+                gpr rhs = operands[1];
+
+                if (dst == rhs && dst != lhs)
+                {
+                    if (encoding.commutative)
+                    {
+                        std::swap(lhs, rhs);
+                    }
+                    else
+                    {
+                        // dst = lhs - dst, as -dst + lhs; only subtraction is non-commutative so far
+                        emitter.neg(node->type, dst);
+                        emitter.alu_rr(0x01, node->type, dst, lhs);
+                        break;
+                    }
+                }
+
+                emitter.mov_rr(node->type, dst, lhs);
+                emitter.alu_rr(encoding.rr_opcode, node->type, dst, rhs);
+                break;
+            }
+            case form::SHIFT: {
+                auto amount = static_cast<uint8_t>(std::get<uint64_t>(node->imm[0]));
+                emitter.mov_rr(node->type, dst, operands[0]);
+                if (bit_width(node->type) < 32 && encoding.digit != 4)
+                {
+                    // the bits above a narrow value are unspecified, so they must not be shifted in
+                    emitter.extend(node->type, dst, dst, encoding.digit == 7);
+                }
+                emitter.shift_ri(encoding.digit, node->type, dst, amount);
+                break;
+            }
+            case form::MUL_HIGH: {
+                gpr lhs = operands[0];
+                gpr rhs = operands[1];
+
+                if (node->type != mc_x86_types::U64)
+                {
+                    // the full product fits a 64-bit register; rhs goes first, as dst may alias it
+                    auto wide = node->type == mc_x86_types::U32 ? mc_x86_types::U64 : mc_x86_types::U32;
+                    emitter.extend(node->type, SCRATCH_REGISTER, rhs, false);
+                    emitter.extend(node->type, dst, lhs, false);
+                    emitter.imul_rr(wide, dst, SCRATCH_REGISTER);
+                    emitter.shift_ri(5, wide, dst, bit_width(node->type));
+                    break;
+                }
+
+                // mul only takes rax and clobbers rdx, both of which may hold live values
+                emitter.push(gpr::RAX);
+                emitter.push(gpr::RDX);
+                emitter.mov_rr(mc_x86_types::U64, SCRATCH_REGISTER, rhs);
+                emitter.mov_rr(mc_x86_types::U64, gpr::RAX, lhs);
+                emitter.mul(mc_x86_types::U64, SCRATCH_REGISTER);
+                emitter.mov_rr(mc_x86_types::U64, SCRATCH_REGISTER, gpr::RDX);
+                emitter.pop(gpr::RDX);
+                emitter.pop(gpr::RAX);
+                emitter.mov_rr(mc_x86_types::U64, dst, SCRATCH_REGISTER);
+                break;
+            }
+            }
+        }
+
+        encoded_block block{0, std::nullopt, 0};
+        if (!assignment.order.empty())
+        {
+            emitter.mov_rr(mc_x86_types::U64, gpr::RAX, assignment.defs.back());
+        }
+        // not hot, the dispatcher links from whichever block this is
+        emitter.lea_buffer(gpr::RDX, 0);
+
+        if (frame_size != 0)
+        {
+            emitter.alu_ri(0, mc_x86_types::U64, gpr::RSP, frame_size);
+        }
+
+        for (auto reg : std::views::reverse(assignment.callee_saved))
+        {
+            emitter.pop(reg);
+        }
+
+        const auto* root = assignment.order.empty() ? nullptr : assignment.order.back();
+        if (root != nullptr && root->opcode == mc_x86_opcode::MOV_ri)
+        {
+            // the frame and saved registers are gone by now, so a chained successor is entered exactly like from the dispatcher
+            emitter.align(4, 1);
+            block.chain_offset = emitter.size() + 1;
+            block.next_pc = std::get<uint64_t>(root->imm[0]) & width_mask(root->type);
+            emitter.jmp(0);
+        }
+        emitter.ret();
+
+        if (emitter.overflowed())
+        {
+            return tl::unexpected(error("x86 code buffer too small", submodule::LOWER));
+        }
+
+        block.size = emitter.size();
+        return block;
+    }
+} // namespace sbrt::x86
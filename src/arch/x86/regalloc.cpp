@@ -0,0 +1,248 @@
+#include "arch/x86/regalloc.h"
+#include "arch/x86/encoder.h"
+#include "arch/x86/instr.h"
+#include "common.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace sbrt::x86
+{
+    namespace
+    {
+        inline constexpr uint32_t NO_SLOT = UINT32_MAX;
+        inline constexpr uint32_t NO_USE = UINT32_MAX;
+
+        constexpr auto reg_bit(gpr reg) -> uint16_t { return static_cast<uint16_t>(1U << static_cast<uint8_t>(reg)); }
+    } // namespace
+
+    void linear_scan_allocator::build_uses(mc_x86_dag& dag)
+    {
+        auto order = dag.post_order();
+        auto count = static_cast<uint32_t>(order.size());
+
+        result.order.assign(order.begin(), order.end());
+        position_of.resize(dag.max_node_id());
+        result.operand_base.resize(count + 1);
+
+        uint32_t operand_count = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            position_of[order[i]->get_id()] = i;
+            result.operand_base[i] = operand_count;
+            operand_count += result.order[i]->operands.size();
+        }
+        result.operand_base[count] = operand_count;
+        result.operands.assign(operand_count, gpr::NONE);
+
+        // counting sort of the uses by the value they read; filling back to front leaves each value's uses in
+        // ascending position order, and use_base[v] at the start of v's range
+        use_base.assign(count + 1, 0);
+        for (auto* node : result.order)
+        {
+            for (auto* operand : node->operands)
+            {
+                use_base[position_of[operand->get_id()]]++;
+            }
+        }
+
+        uint32_t running = 0;
+        for (auto& base : use_base)
+        {
+            running += base;
+            base = running;
+        }
+
+        uses.resize(operand_count);
+        for (uint32_t i = count; i-- > 0;)
+        {
+            const auto& operands = result.order[i]->operands;
+            for (uint32_t j = operands.size(); j-- > 0;)
+            {
+                uses[--use_base[position_of[operands[j]->get_id()]]] = {i, result.operand_base[i] + j};
+            }
+        }
+    }
+
+    void linear_scan_allocator::finish(live_interval& interval, uint32_t until)
+    {
+        uint32_t end = use_base[interval.value + 1];
+        while (interval.next_use < end && uses[interval.next_use].position * 2 < until)
+        {
+            result.operands[uses[interval.next_use].operand] = interval.reg;
+            interval.next_use++;
+        }
+    }
+
+    void linear_scan_allocator::expire(uint32_t position)
+    {
+        for (size_t i = 0; i < active.size();)
+        {
+            auto& interval = intervals[active[i]];
+            if (interval.end < position)
+            {
+                finish(interval, UINT32_MAX);
+                free_regs |= reg_bit(interval.reg);
+                active[i] = active.back();
+                active.pop_back();
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+    auto linear_scan_allocator::next_use_after(const live_interval& interval, uint32_t position) const -> uint32_t
+    {
+        for (uint32_t i = interval.next_use; i < use_base[interval.value + 1]; i++)
+        {
+            if (uses[i].position * 2 >= position)
+            {
+                return uses[i].position;
+            }
+        }
+
+        return NO_USE;
+    }
+
+    auto linear_scan_allocator::take_register() -> gpr
+    {
+        for (auto reg : ALLOCATABLE)
+        {
+            if ((free_regs & reg_bit(reg)) != 0)
+            {
+                free_regs &= ~reg_bit(reg);
+                used_regs |= reg_bit(reg);
+                return reg;
+            }
+        }
+
+        sbrt_unreachable(submodule::LOWER);
+    }
+
+    auto linear_scan_allocator::split_furthest(uint32_t position) -> gpr
+    {
+        size_t victim = active.size();
+        uint32_t victim_use = 0;
+        for (size_t i = 0; i < active.size(); i++)
+        {
+            // intervals read by the instruction being reloaded for have to stay where they are
+            uint32_t next = next_use_after(intervals[active[i]], position);
+            if (next != NO_USE && next * 2 > position && next >= victim_use)
+            {
+                victim = i;
+                victim_use = next;
+            }
+        }
+
+        sbrt_assert(submodule::LOWER, victim != active.size());
+
+        auto& interval = intervals[active[victim]];
+        finish(interval, position);
+
+        if (slot_of[interval.value] == NO_SLOT)
+        {
+            slot_of[interval.value] = result.spill_slots++;
+            result.moves.push_back({interval.reg, false, slot_of[interval.value]});
+            move_positions.push_back(position / 2);
+        }
+
+        gpr reg = interval.reg;
+        live_interval rest{victim_use * 2, interval.end, interval.value, interval.next_use, gpr::NONE};
+
+        active[victim] = active.back();
+        active.pop_back();
+
+        intervals.push_back(rest);
+        unhandled.push_back(intervals.size() - 1);
+        std::ranges::push_heap(unhandled, std::ranges::greater{}, by_start());
+        return reg;
+    }
+
+    auto linear_scan_allocator::allocate(mc_x86_dag& dag) -> const register_assignment&
+    {
+        build_uses(dag);
+        auto count = static_cast<uint32_t>(result.order.size());
+
+        result.defs.assign(count, gpr::NONE);
+        result.moves.clear();
+        result.spill_slots = 0;
+        move_positions.clear();
+        slot_of.assign(count, NO_SLOT);
+
+        free_regs = 0;
+        used_regs = 0;
+        for (auto reg : ALLOCATABLE)
+        {
+            free_regs |= reg_bit(reg);
+        }
+
+        intervals.clear();
+        unhandled.clear();
+        active.clear();
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t end = use_base[i] != use_base[i + 1] ? uses[use_base[i + 1] - 1].position * 2 : i * 2 + 1;
+            if (i + 1 == count)
+            {
+                // the root is moved out of its register after the last instruction
+                end = count * 2;
+            }
+
+            intervals.push_back({i * 2 + 1, end, i, use_base[i], gpr::NONE});
+            unhandled.push_back(i);
+        }
+        std::ranges::make_heap(unhandled, std::ranges::greater{}, by_start());
+
+        while (!unhandled.empty())
+        {
+            std::ranges::pop_heap(unhandled, std::ranges::greater{}, by_start());
+            uint32_t current = unhandled.back();
+            unhandled.pop_back();
+
+            uint32_t start = intervals[current].start;
+            expire(start);
+            gpr reg = free_regs != 0 ? take_register() : split_furthest(start);
+
+            auto& interval = intervals[current];
+            interval.reg = reg;
+            if (start % 2 == 1)
+            {
+                result.defs[interval.value] = reg;
+            }
+            else
+            {
+                result.moves.push_back({reg, true, slot_of[interval.value]});
+                move_positions.push_back(start / 2);
+            }
+
+            active.push_back(current);
+        }
+
+        expire(UINT32_MAX);
+
+        result.callee_saved.clear();
+        for (auto reg : CALLEE_SAVED)
+        {
+            if ((used_regs & reg_bit(reg)) != 0)
+            {
+                result.callee_saved.push_back(reg);
+            }
+        }
+
+        // moves were generated in position order
+        result.move_base.assign(count + 1, 0);
+        for (auto position : move_positions)
+        {
+            result.move_base[position + 1]++;
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            result.move_base[i + 1] += result.move_base[i];
+        }
+
+        return result;
+    }
+} // namespace sbrt::x86
@@ -0,0 +1,82 @@
+#include "io.h"
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace sbrt::detail
+{
+    namespace
+    {
+        auto errno_error(const char* what, const std::string& path) -> io_error
+        {
+            return io_error(fmt::format("{} {}: {}", what, path, std::strerror(errno)));
+        }
+    } // namespace
+
+    mapped_file::mapped_file(const std::string& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            throw errno_error("failed to open", path);
+        }
+
+        struct stat info{};
+        if (fstat(fd, &info) != 0)
+        {
+            auto err = errno_error("failed to stat", path);
+            ::close(fd);
+            throw err;
+        }
+
+        // mmap rejects empty mappings, and an empty file needs none
+        if (info.st_size > 0)
+        {
+            void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED)
+            {
+                auto err = errno_error("failed to map", path);
+                ::close(fd);
+                throw err;
+            }
+
+            madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+            data = static_cast<uint8_t*>(mapping);
+            size = info.st_size;
+        }
+
+        // the mapping keeps its own reference to the file
+        ::close(fd);
+    }
+
+    mapped_file::mapped_file(mapped_file&& other) noexcept
+        : data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0))
+    {
+    }
+
+    auto mapped_file::operator=(mapped_file&& other) noexcept -> mapped_file&
+    {
+        if (this != &other)
+        {
+            std::swap(data, other.data);
+            std::swap(size, other.size);
+        }
+        return *this;
+    }
+
+    mapped_file::~mapped_file()
+    {
+        if (data != nullptr)
+        {
+            munmap(const_cast<uint8_t*>(data), size);
+        }
+    }
+} // namespace sbrt::detail
@@ -0,0 +1,123 @@
+#include "jit/background_compiler.h"
+#include "arch/x86/encoder.h"
+#include "arch/x86/regalloc.h"
+#include "jit/lowering.h"
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fmt/core.h>
+#include <iterator>
+#include <mutex>
+#include <utility>
+
+namespace sbrt::jit
+{
+    background_compiler::background_compiler(block_frontend source, const transformer<ir::ir_dag>& optimizer, size_t threads)
+        : source(std::move(source)), optimizer(optimizer)
+    {
+        workers.reserve(threads);
+        for (size_t i = 0; i < threads; i++)
+        {
+            workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    background_compiler::~background_compiler()
+    {
+        {
+            std::lock_guard lock(queue_mutex);
+            stopping = true;
+        }
+        queue_ready.notify_all();
+        // the jthreads join as they are destroyed, before anything they use
+    }
+
+    void background_compiler::submit(uint64_t guest_pc)
+    {
+        {
+            std::lock_guard lock(queue_mutex);
+            queue.push_back(guest_pc);
+        }
+        queue_ready.notify_one();
+    }
+
+    void background_compiler::collect(std::vector<compile_result>& out)
+    {
+        std::unique_lock lock(done_mutex, std::try_to_lock);
+        if (!lock.owns_lock() || done.empty())
+        {
+            return;
+        }
+
+        std::move(done.begin(), done.end(), std::back_inserter(out));
+        done.clear();
+    }
+
+    auto background_compiler::compile(uint64_t guest_pc, x86::linear_scan_allocator& allocator) -> tl::expected<compiled_block, error>
+    {
+        auto selected = select_block(source, guest_pc, tier::OPTIMIZED, optimizer);
+        if (!selected)
+        {
+            return tl::unexpected(selected.error());
+        }
+
+        const auto& assignment = allocator.allocate(*selected);
+        compiled_block block{u8_buf(x86::max_encoded_size(assignment)), {}};
+
+        auto layout = x86::encode_block(assignment, block.code, {nullptr, guest_pc});
+        if (!layout)
+        {
+            return tl::unexpected(layout.error());
+        }
+
+        block.code.resize(layout->size);
+        block.layout = *layout;
+        return block;
+    }
+
+    void background_compiler::work()
+    {
+        // per worker, so that allocation scratch is reused across the blocks it compiles
+        x86::linear_scan_allocator allocator;
+
+        while (true)
+        {
+            uint64_t guest_pc = 0;
+            {
+                std::unique_lock lock(queue_mutex);
+                queue_ready.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if (stopping)
+                {
+                    return;
+                }
+
+                guest_pc = queue.front();
+                queue.pop_front();
+            }
+
+            // an exception escaping a jthread terminates the process, so whatever the pipeline, isel or the encoder
+            // throw fails just this block
+            auto result = [&]() -> tl::expected<compiled_block, error> {
+                try
+                {
+                    return compile(guest_pc, allocator);
+                }
+                catch (error& e)
+                {
+                    return tl::unexpected(std::move(e));
+                }
+                catch (const std::exception& e)
+                {
+                    return tl::unexpected(error(fmt::format("compiling {:#x} threw: {}", guest_pc, e.what()), submodule::MISC));
+                }
+                catch (...)
+                {
+                    return tl::unexpected(error(fmt::format("compiling {:#x} threw an unknown exception", guest_pc), submodule::MISC));
+                }
+            }();
+
+            std::lock_guard lock(done_mutex);
+            done.push_back({guest_pc, std::move(result)});
+        }
+    }
+} // namespace sbrt::jit
@@ -0,0 +1,128 @@
+#include "jit/block_linker.h"
+#include "arch/x86/encoder.h"
+#include "common.h"
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+
+namespace sbrt::jit
+{
+    void block_linker::patch(exit_site& exit, uintptr_t target)
+    {
+        // rel32 of 0 lands on the `ret` right after the jump
+        uintptr_t destination = target != 0 ? target : exit.patch + 4;
+        auto rel = static_cast<int64_t>(destination) - static_cast<int64_t>(exit.patch + 4);
+        sbrt_assert(submodule::JIT, rel >= INT32_MIN && rel <= INT32_MAX);
+
+        cache.patch_u32(exit.patch, static_cast<uint32_t>(rel));
+        exit.target = target;
+    }
+
+    void block_linker::drop_incoming(uintptr_t target, uintptr_t source)
+    {
+        auto it = incoming.find(target);
+        if (it == incoming.end())
+        {
+            return;
+        }
+
+        auto& sources = it->second;
+        sources.erase(std::ranges::find(sources, source));
+        if (sources.empty())
+        {
+            incoming.erase(it);
+        }
+    }
+
+    void block_linker::add_block(uintptr_t entry, const x86::encoded_block& block)
+    {
+        if (block.chain_offset)
+        {
+            exits[entry] = {entry + *block.chain_offset, block.next_pc, 0};
+        }
+    }
+
+    auto block_linker::next_pc_of(uintptr_t source) const -> std::optional<uint64_t>
+    {
+        auto it = exits.find(source);
+        if (it == exits.end())
+        {
+            return std::nullopt;
+        }
+
+        return it->second.next_pc;
+    }
+
+    void block_linker::link(uintptr_t source, uintptr_t target)
+    {
+        auto it = exits.find(source);
+        if (it == exits.end() || it->second.target == target)
+        {
+            return;
+        }
+
+        auto& exit = it->second;
+        if (exit.target != 0)
+        {
+            drop_incoming(exit.target, source);
+        }
+
+        patch(exit, target);
+        incoming[target].push_back(source);
+    }
+
+    void block_linker::unlink_target(uintptr_t target)
+    {
+        auto it = incoming.find(target);
+        if (it == incoming.end())
+        {
+            return;
+        }
+
+        for (auto source : it->second)
+        {
+            patch(exits.at(source), 0);
+        }
+
+        incoming.erase(it);
+    }
+
+    void block_linker::evict_range(uintptr_t begin, uintptr_t end)
+    {
+        auto in_range = [=](uintptr_t address) { return address >= begin && address < end; };
+
+        // jumps from surviving blocks into the evicted ones have to go back to the dispatcher
+        for (auto it = incoming.begin(); it != incoming.end();)
+        {
+            if (!in_range(it->first))
+            {
+                ++it;
+                continue;
+            }
+
+            for (auto source : it->second)
+            {
+                if (!in_range(source))
+                {
+                    patch(exits.at(source), 0);
+                }
+            }
+            it = incoming.erase(it);
+        }
+
+        for (auto it = exits.begin(); it != exits.end();)
+        {
+            if (!in_range(it->first))
+            {
+                ++it;
+                continue;
+            }
+
+            if (it->second.target != 0 && !in_range(it->second.target))
+            {
+                drop_incoming(it->second.target, it->first);
+            }
+            it = exits.erase(it);
+        }
+    }
+} // namespace sbrt::jit
@@ -0,0 +1,136 @@
+#include "jit/block_table.h"
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace sbrt::jit
+{
+    block_table::block_table(size_t capacity) : entries(std::make_unique<entry[]>(std::bit_ceil(capacity))), mask(std::bit_ceil(capacity) - 1)
+    {
+        reset();
+    }
+
+    auto block_table::reserve_claim() -> bool
+    {
+        size_t limit = (mask + 1) / 4 * 3;
+        size_t count = claimed.load(std::memory_order_relaxed);
+        do
+        {
+            if (count >= limit)
+            {
+                return false;
+            }
+        } while (!claimed.compare_exchange_weak(count, count + 1, std::memory_order_relaxed));
+
+        return true;
+    }
+
+    auto block_table::insert(uint64_t guest, uintptr_t host) -> bool
+    {
+        if (guest == EMPTY)
+        {
+            uintptr_t old = empty_host.exchange(host, std::memory_order_acq_rel);
+            if (old != 0 && old != host)
+            {
+                epoch.fetch_add(1, std::memory_order_acq_rel);
+            }
+            return true;
+        }
+
+        for (size_t slot = hash(guest) & mask;; slot = (slot + 1) & mask)
+        {
+            auto& entry = entries[slot];
+            uint64_t key = entry.guest.load(std::memory_order_acquire);
+
+            if (key == EMPTY)
+            {
+                if (!reserve_claim())
+                {
+                    return false;
+                }
+
+                if (entry.guest.compare_exchange_strong(key, guest, std::memory_order_acq_rel))
+                {
+                    key = guest;
+                }
+                else
+                {
+                    // another thread claimed the slot first, and `key` now holds its pc
+                    claimed.fetch_sub(1, std::memory_order_relaxed);
+                }
+            }
+
+            if (key == guest)
+            {
+                uintptr_t old = entry.host.exchange(host, std::memory_order_acq_rel);
+                if (old != 0 && old != host)
+                {
+                    // cached copies of the replaced block have to go, or the dispatcher would keep running it
+                    epoch.fetch_add(1, std::memory_order_acq_rel);
+                }
+                return true;
+            }
+        }
+    }
+
+    void block_table::erase(uint64_t guest)
+    {
+        if (guest == EMPTY)
+        {
+            empty_host.store(0, std::memory_order_release);
+            epoch.fetch_add(1, std::memory_order_acq_rel);
+            return;
+        }
+
+        for (size_t slot = hash(guest) & mask;; slot = (slot + 1) & mask)
+        {
+            uint64_t key = entries[slot].guest.load(std::memory_order_acquire);
+            if (key == guest)
+            {
+                entries[slot].host.store(0, std::memory_order_release);
+                epoch.fetch_add(1, std::memory_order_acq_rel);
+                return;
+            }
+
+            if (key == EMPTY)
+            {
+                return;
+            }
+        }
+    }
+
+    void block_table::erase_host_range(uintptr_t begin, uintptr_t end)
+    {
+        for (size_t slot = 0; slot <= mask; slot++)
+        {
+            uintptr_t host = entries[slot].host.load(std::memory_order_relaxed);
+            if (host >= begin && host < end)
+            {
+                entries[slot].host.store(0, std::memory_order_release);
+            }
+        }
+
+        uintptr_t host = empty_host.load(std::memory_order_relaxed);
+        if (host >= begin && host < end)
+        {
+            empty_host.store(0, std::memory_order_release);
+        }
+
+        epoch.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    void block_table::reset()
+    {
+        for (size_t slot = 0; slot <= mask; slot++)
+        {
+            entries[slot].guest.store(EMPTY, std::memory_order_relaxed);
+            entries[slot].host.store(0, std::memory_order_relaxed);
+        }
+
+        empty_host.store(0, std::memory_order_relaxed);
+        claimed.store(0, std::memory_order_relaxed);
+        epoch.fetch_add(1, std::memory_order_acq_rel);
+    }
+} // namespace sbrt::jit
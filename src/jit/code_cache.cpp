@@ -0,0 +1,257 @@
+#include "jit/code_cache.h"
+#include "cast.h"
+#include "common.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fmt/core.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+
+namespace sbrt::jit
+{
+    namespace
+    {
+        auto errno_error(const char* what) -> error { return error(fmt::format("{}: {}", what, std::strerror(errno)), submodule::JIT); }
+
+        constexpr int WRITABLE = PROT_READ | PROT_WRITE;
+        constexpr int EXECUTABLE = PROT_READ | PROT_EXEC;
+        // for patching code that may be running on another thread, which must not lose exec rights meanwhile
+        constexpr int PATCHABLE = PROT_READ | PROT_WRITE | PROT_EXEC;
+
+        constexpr auto align_up(size_t value, size_t alignment) -> size_t { return (value + alignment - 1) & ~(alignment - 1); }
+    } // namespace
+
+    code_cache::code_cache(uint8_t* rw_view, uint8_t* rx_view, size_t capacity, size_t regions, bool dual_mapped)
+        : rw_view(rw_view), rx_view(rx_view), capacity(capacity), region_size(capacity / regions), dual_mapped(dual_mapped),
+          region_generations(regions, 0)
+    {
+    }
+
+    code_cache::code_cache(code_cache&& other) noexcept
+        : rw_view(std::exchange(other.rw_view, nullptr)), rx_view(std::exchange(other.rx_view, nullptr)), capacity(std::exchange(other.capacity, 0)),
+          region_size(other.region_size), dual_mapped(other.dual_mapped), current_region(other.current_region), bump(other.bump),
+          region_generations(std::move(other.region_generations)), write_depth(other.write_depth), reserved(other.reserved),
+          on_evict(std::move(other.on_evict))
+    {
+    }
+
+    auto code_cache::operator=(code_cache&& other) noexcept -> code_cache&
+    {
+        if (this != &other)
+        {
+            release();
+            rw_view = std::exchange(other.rw_view, nullptr);
+            rx_view = std::exchange(other.rx_view, nullptr);
+            capacity = std::exchange(other.capacity, 0);
+            region_size = other.region_size;
+            dual_mapped = other.dual_mapped;
+            current_region = other.current_region;
+            bump = other.bump;
+            region_generations = std::move(other.region_generations);
+            write_depth = other.write_depth;
+            reserved = other.reserved;
+            on_evict = std::move(other.on_evict);
+        }
+        return *this;
+    }
+
+    code_cache::~code_cache() { release(); }
+
+    void code_cache::release()
+    {
+        if (rx_view != nullptr)
+        {
+            munmap(rx_view, capacity);
+        }
+
+        if (dual_mapped && rw_view != nullptr)
+        {
+            munmap(rw_view, capacity);
+        }
+
+        rw_view = nullptr;
+        rx_view = nullptr;
+    }
+
+    auto code_cache::create(size_t capacity, size_t regions) -> tl::expected<code_cache, error>
+    {
+        sbrt_assert(submodule::JIT, regions > 0);
+
+        size_t region_size = align_up(std::max<size_t>(capacity / regions, 1), static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+        capacity = region_size * regions;
+
+        // dual mapping through a memfd; falls back to a single mapping if the platform refuses either view
+        int fd = memfd_create("sbrt-code-cache", MFD_CLOEXEC);
+        if (fd >= 0)
+        {
+            void* rw_view = MAP_FAILED;
+            void* rx_view = MAP_FAILED;
+            if (ftruncate(fd, static_cast<off_t>(capacity)) == 0)
+            {
+                rw_view = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                rx_view = mmap(nullptr, capacity, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+            }
+            close(fd);
+
+            if (rw_view != MAP_FAILED && rx_view != MAP_FAILED)
+            {
+                return code_cache(cast_ptr<uint8_t>(rw_view), cast_ptr<uint8_t>(rx_view), capacity, regions, true);
+            }
+
+            if (rw_view != MAP_FAILED)
+            {
+                munmap(rw_view, capacity);
+            }
+
+            if (rx_view != MAP_FAILED)
+            {
+                munmap(rx_view, capacity);
+            }
+        }
+
+        void* view = mmap(nullptr, capacity, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (view == MAP_FAILED)
+        {
+            return tl::unexpected(errno_error("failed to map code cache"));
+        }
+
+        return code_cache(cast_ptr<uint8_t>(view), cast_ptr<uint8_t>(view), capacity, regions, false);
+    }
+
+    void code_cache::protect_region(size_t region, int protection)
+    {
+        if (dual_mapped)
+        {
+            return;
+        }
+
+        if (mprotect(rx_view + region * region_size, region_size, protection) != 0)
+        {
+            errno_error("failed to change code cache protection").do_throw();
+        }
+    }
+
+    void code_cache::begin_write()
+    {
+        if (write_depth++ == 0)
+        {
+            protect_region(current_region, WRITABLE);
+        }
+    }
+
+    void code_cache::end_write()
+    {
+        sbrt_assert(submodule::JIT, write_depth > 0);
+        if (--write_depth == 0)
+        {
+            protect_region(current_region, EXECUTABLE);
+        }
+    }
+
+    void code_cache::evict_region(size_t region)
+    {
+        if (on_evict)
+        {
+            uintptr_t begin = as_uptr(rx_view + region * region_size);
+            on_evict(begin, begin + region_size);
+        }
+
+        region_generations[region]++;
+    }
+
+    void code_cache::advance_region()
+    {
+        size_t next = (current_region + 1) % region_generations.size();
+        evict_region(next);
+
+        if (write_depth > 0)
+        {
+            protect_region(current_region, EXECUTABLE);
+            protect_region(next, WRITABLE);
+        }
+
+        current_region = next;
+        bump = 0;
+    }
+
+    auto code_cache::reserve(size_t size) -> tl::expected<code_reservation, error>
+    {
+        sbrt_assert(submodule::JIT, !reserved);
+        sbrt_assert(submodule::JIT, dual_mapped || write_depth > 0);
+
+        if (size > region_size)
+        {
+            return tl::unexpected(error(fmt::format("block of {} bytes does not fit a code cache region of {}", size, region_size), submodule::JIT));
+        }
+
+        size_t offset = align_up(bump, BLOCK_ALIGNMENT);
+        if (offset + size > region_size)
+        {
+            advance_region();
+            offset = 0;
+        }
+
+        size_t at = current_region * region_size + offset;
+        bump = offset;
+        reserved = true;
+        return code_reservation{u8_slice(rw_view + at, size), as_uptr(rx_view + at)};
+    }
+
+    void code_cache::commit(const code_reservation& reservation, size_t used)
+    {
+        sbrt_assert(submodule::JIT, reserved && used <= reservation.writable.size());
+        bump += used;
+        reserved = false;
+    }
+
+    auto code_cache::install(std::span<const uint8_t> code) -> tl::expected<uintptr_t, error>
+    {
+        code_cache_writer writer(*this);
+
+        auto reservation = reserve(code.size());
+        if (!reservation)
+        {
+            return tl::unexpected(reservation.error());
+        }
+
+        std::memcpy(reservation->writable.data(), code.data(), code.size());
+        commit(*reservation, code.size());
+        return reservation->exec;
+    }
+
+    void code_cache::patch_u32(uintptr_t exec, uint32_t value)
+    {
+        sbrt_assert(submodule::JIT, contains(exec) && exec % sizeof(uint32_t) == 0);
+
+        size_t offset = exec - as_uptr(rx_view);
+        size_t region = offset / region_size;
+        bool writable = dual_mapped || (write_depth > 0 && region == current_region);
+
+        if (!writable)
+        {
+            protect_region(region, PATCHABLE);
+        }
+
+        std::atomic_ref<uint32_t>(*cast_ptr<uint32_t>(rw_view + offset)).store(value, std::memory_order_release);
+
+        if (!writable)
+        {
+            protect_region(region, EXECUTABLE);
+        }
+    }
+
+    void code_cache::flush()
+    {
+        for (size_t region = 0; region < region_generations.size(); region++)
+        {
+            evict_region(region);
+        }
+
+        bump = 0;
+    }
+} // namespace sbrt::jit
@@ -0,0 +1,38 @@
+#include "jit/lowering.h"
+#include "arch/x86/instr.h"
+#include "arch/x86/isel.h"
+#include "instr/ir.h"
+#include "pass/isel_generic_pass.h"
+#include <cstdint>
+#include <utility>
+
+namespace sbrt::jit
+{
+    auto select_block(const block_frontend& source, uint64_t guest_pc, tier level, const transformer<ir::ir_dag>& optimizer)
+        -> tl::expected<x86::mc_x86_dag, error>
+    {
+        auto ir = source(guest_pc);
+        if (!ir)
+        {
+            return tl::unexpected(ir.error());
+        }
+
+        if (level == tier::OPTIMIZED)
+        {
+            ir = optimizer.transform(std::move(*ir));
+            if (!ir)
+            {
+                return tl::unexpected(ir.error());
+            }
+        }
+
+        auto lowered = passes::isel::ir_to_isel{}.transform(std::move(*ir));
+        if (!lowered)
+        {
+            return tl::unexpected(lowered.error());
+        }
+
+        auto mode = level == tier::OPTIMIZED ? passes::isel::isel_mode::OPTIMAL : passes::isel::isel_mode::FIRST_MATCH;
+        return x86::x86_isel_pass{mode}.transform(std::move(*lowered));
+    }
+} // namespace sbrt::jit
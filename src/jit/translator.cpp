@@ -0,0 +1,243 @@
+#include "jit/translator.h"
+#include "arch/x86/encoder.h"
+#include "arch/x86/instr.h"
+#include "cast.h"
+#include "common.h"
+#include "instr/ir.h"
+#include "jit/lowering.h"
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+namespace sbrt::jit
+{
+    tiered_translator::tiered_translator(
+        code_cache& cache, block_table& table, block_linker& linker, frontend source, transformer_ref<ir::ir_dag> optimizer, int64_t hot_threshold
+    )
+        : cache(cache), table(table), linker(linker), source(std::move(source)), optimizer(std::move(optimizer)), hot_threshold(hot_threshold),
+          lookup_cache(table)
+    {
+        cache.set_evict_callback([this](uintptr_t begin, uintptr_t end) { evict(begin, end); });
+    }
+
+    void tiered_translator::evict(uintptr_t begin, uintptr_t end)
+    {
+        table.erase_host_range(begin, end);
+        linker.evict_range(begin, end);
+
+        // records stay, so that an optimized block is sent back to the background compiler as soon as it comes back
+        for (auto& [guest_pc, record] : blocks)
+        {
+            if (record.entry >= begin && record.entry < end)
+            {
+                record.entry = 0;
+            }
+        }
+
+        if (last_entry >= begin && last_entry < end)
+        {
+            last_entry = 0;
+        }
+    }
+
+    auto tiered_translator::emit(uint64_t guest_pc, x86::mc_x86_dag&& dag, int64_t* counter) -> tl::expected<uintptr_t, error>
+    {
+        const auto& assignment = allocator.allocate(dag);
+
+        code_cache_writer writer(cache);
+        auto reservation = cache.reserve(x86::max_encoded_size(assignment));
+        if (!reservation)
+        {
+            return tl::unexpected(reservation.error());
+        }
+
+        auto block = x86::encode_block(assignment, reservation->writable, {counter, guest_pc});
+        if (!block)
+        {
+            cache.commit(*reservation, 0);
+            return tl::unexpected(block.error());
+        }
+
+        cache.commit(*reservation, block->size);
+        linker.add_block(reservation->exec, *block);
+        return reservation->exec;
+    }
+
+    auto tiered_translator::publish(uint64_t guest_pc, tier level, uintptr_t entry) -> uintptr_t
+    {
+        auto& record = blocks[guest_pc];
+        uintptr_t old = std::exchange(record.entry, entry);
+        record.level = level;
+
+        if (!table.insert(guest_pc, entry))
+        {
+            // only the dispatcher looks blocks up, and it is not inside a block right now
+            table.reset();
+            table.insert(guest_pc, entry);
+        }
+
+        if (old != 0)
+        {
+            linker.unlink_target(old);
+        }
+
+        return entry;
+    }
+
+    auto tiered_translator::translate(uint64_t guest_pc, tier level) -> tl::expected<uintptr_t, error>
+    {
+        auto selected = select_block(source, guest_pc, level, *optimizer);
+        if (!selected)
+        {
+            return tl::unexpected(selected.error());
+        }
+
+        int64_t* counter = nullptr;
+        if (level == tier::BASELINE)
+        {
+            auto& record = blocks[guest_pc];
+            if (record.counter == nullptr)
+            {
+                record.counter = counters.create<int64_t>();
+            }
+            *record.counter = hot_threshold;
+            counter = record.counter;
+        }
+
+        auto entry = emit(guest_pc, std::move(*selected), counter);
+        if (!entry)
+        {
+            return entry;
+        }
+
+        return publish(guest_pc, level, *entry);
+    }
+
+    auto tiered_translator::install_finished() -> tl::expected<void, error>
+    {
+        finished.clear();
+        background->collect(finished);
+
+        // every result is handled, failed or not, so no pc stays queued forever; the first error is reported after
+        tl::expected<void, error> status;
+        for (auto& result : finished)
+        {
+            blocks[result.guest_pc].queued = false;
+
+            if (!result.block)
+            {
+                if (status)
+                {
+                    status = tl::unexpected(result.block.error());
+                }
+                continue;
+            }
+
+            auto entry = cache.install(result.block->code);
+            if (!entry)
+            {
+                if (status)
+                {
+                    status = tl::unexpected(entry.error());
+                }
+                continue;
+            }
+
+            linker.add_block(*entry, result.block->layout);
+            publish(result.guest_pc, tier::OPTIMIZED, *entry);
+        }
+
+        return status;
+    }
+
+    void tiered_translator::queue_optimization(uint64_t guest_pc)
+    {
+        auto& record = blocks[guest_pc];
+        if (!record.queued)
+        {
+            record.queued = true;
+            background->submit(guest_pc);
+        }
+    }
+
+    auto tiered_translator::resolve(uint64_t guest_pc) -> tl::expected<uintptr_t, error>
+    {
+        uintptr_t entry = lookup_cache.lookup(guest_pc);
+        if (entry != 0)
+        {
+            return entry;
+        }
+
+        auto it = blocks.find(guest_pc);
+        bool was_optimized = it != blocks.end() && it->second.level == tier::OPTIMIZED;
+
+        // optimizing here would stall the executing thread, so the block runs at the baseline tier until it is back
+        auto translated = translate(guest_pc, tier::BASELINE);
+        if (translated && was_optimized && background != nullptr)
+        {
+            queue_optimization(guest_pc);
+        }
+
+        return translated;
+    }
+
+    auto tiered_translator::step(uint64_t guest_pc) -> tl::expected<uint64_t, error>
+    {
+        if (background != nullptr)
+        {
+            auto installed = install_finished();
+            if (!installed)
+            {
+                return tl::unexpected(installed.error());
+            }
+        }
+
+        auto entry = resolve(guest_pc);
+        if (!entry)
+        {
+            return tl::unexpected(entry.error());
+        }
+
+        if (last_entry != 0 && linker.next_pc_of(last_entry) == guest_pc)
+        {
+            linker.link(last_entry, *entry);
+        }
+
+        auto exit = as_ptr<x86::block_exit()>(*entry)();
+        // the block that came back, which is the last one of the chain that ran; linking from the entered block would
+        // never repair a link further down that was dropped
+        last_entry = exit.block();
+
+        if (exit.hot())
+        {
+            // the hot block has not run, so it is simply entered again from the dispatcher, replaced or not; its counter
+            // is past zero by then and does not fire again
+            last_entry = 0;
+            if (background != nullptr)
+            {
+                queue_optimization(exit.next_pc);
+            }
+            else
+            {
+                auto optimized = translate(exit.next_pc, tier::OPTIMIZED);
+                if (!optimized)
+                {
+                    return tl::unexpected(optimized.error());
+                }
+            }
+        }
+
+        return exit.next_pc;
+    }
+
+    auto tiered_translator::tier_of(uint64_t guest_pc) const -> std::optional<tier>
+    {
+        auto it = blocks.find(guest_pc);
+        if (it == blocks.end())
+        {
+            return std::nullopt;
+        }
+
+        return it->second.level;
+    }
+} // namespace sbrt::jit
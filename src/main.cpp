@@ -3,6 +3,8 @@
 #include "common.h"
 #include "dag_writer.h"
 #include "instr/ir.h"
+#include "pass/constant_folding_pass.h"
+#include "pass/dce_pass.h"
 #include <bits/stl_algo.h>
 #include <csignal>
 #include <cstdlib>
@@ -50,6 +52,7 @@ auto main() -> int
     setup_handlers();
 
     sbrt::ir::ir_dag dag;
+    dag.enable_cse();
     sbrt::ir::ir_dag_node* imm = dag.create(nullptr, sbrt::ir::ir_opcode::IMM, sbrt::ir::ir_types::U32, sbrt::ir::ir_imm_type(1Ul));
 
     dag.root(dag.create(
@@ -60,8 +63,10 @@ auto main() -> int
 
     sbrt::dag_dot_emitter<sbrt::ir::ir_instr_specific_info> ir_out{std::cout};
     dag.emit_dot(ir_out);
+    auto folded = sbrt::passes::opt::constant_folding{}.transform(std::move(dag));
+    auto live = sbrt::passes::opt::dead_node_elimination{}.transform(std::move(*folded));
     sbrt::x86::x86_isel_pass pass;
-    auto out = pass.transform(std::move(dag));
+    auto out = pass.transform(std::move(*live));
 
     sbrt::dag_dot_emitter<sbrt::x86::mc_x86_instr_specific_info> mc_out{std::cout};
     out->emit_dot(mc_out);
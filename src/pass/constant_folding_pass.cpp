@@ -0,0 +1,115 @@
+#include "pass/constant_folding_pass.h"
+#include "instr/ir.h"
+#include "pass/analysis.h"
+#include "pass/known_bits_analysis.h"
+#include "pass/opt_util.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+namespace sbrt::passes::opt
+{
+    namespace
+    {
+        /**
+         * The operand that `node` is equal to by an identity, if there is one
+         */
+        auto identity_of(ir::ir_dag_node* node, std::optional<uint64_t> lhs, std::optional<uint64_t> rhs) -> ir::ir_dag_node*
+        {
+            auto* lhs_node = node->operands[0];
+            auto* rhs_node = node->operands[1];
+
+            switch (node->opcode)
+            {
+            case ir::ir_opcode::ADD:
+                if (rhs == 0)
+                {
+                    return lhs_node;
+                }
+                return lhs == 0 ? rhs_node : nullptr;
+            case ir::ir_opcode::SUB:
+                return rhs == 0 ? lhs_node : nullptr;
+            case ir::ir_opcode::MUL:
+                if (rhs == 1)
+                {
+                    return lhs_node;
+                }
+                return lhs == 1 ? rhs_node : nullptr;
+            case ir::ir_opcode::UDIV:
+            case ir::ir_opcode::SDIV:
+                return rhs == 1 ? lhs_node : nullptr;
+            case ir::ir_opcode::SHL:
+            case ir::ir_opcode::LSHR:
+            case ir::ir_opcode::ASHR:
+                return rhs == 0 ? lhs_node : nullptr;
+            default:
+                return nullptr;
+            }
+        }
+    } // namespace
+
+    auto constant_folding::transform_with(ir::ir_dag&& _dag, analysis_manager<ir::ir_dag>& analyses) const -> result_t
+    {
+        ir::ir_dag dag = std::move(_dag);
+        // only kept up to date when some earlier pass already wanted it; the nodes whose facts may have changed are
+        // updated in one go at the end, which is fine as users are visited after their operands and only look at
+        // constants
+        auto* known_bits = analyses.get_if_cached<known_bits_analysis>();
+
+        for (auto* node : dag.post_order())
+        {
+            size_t bits = node->type.bit_width();
+            if (node->opcode == ir::ir_opcode::IMM || node->chain != nullptr || node->operands.size() != 2 || bits == 0)
+            {
+                continue;
+            }
+
+            auto lhs = constant_of(node->operands[0]);
+            auto rhs = constant_of(node->operands[1]);
+
+            if (lhs && rhs)
+            {
+                if (auto value = evaluate(node->opcode, *lhs, *rhs, bits))
+                {
+                    make_constant(dag, node, *value);
+                    if (known_bits != nullptr)
+                    {
+                        known_bits->defer(node);
+                    }
+                }
+                continue;
+            }
+
+            bool same = node->operands[0] == node->operands[1];
+            bool has_zero = lhs == 0 || rhs == 0;
+            bool is_product = node->opcode == ir::ir_opcode::MUL || node->opcode == ir::ir_opcode::UMULH;
+            if ((node->opcode == ir::ir_opcode::SUB && same) || (is_product && has_zero))
+            {
+                make_constant(dag, node, 0);
+                if (known_bits != nullptr)
+                {
+                    known_bits->defer(node);
+                }
+                continue;
+            }
+
+            auto* replacement = identity_of(node, lhs, rhs);
+            if (replacement != nullptr && replacement->type == node->type)
+            {
+                dag.replace_all_uses_with(node, replacement);
+                if (known_bits != nullptr)
+                {
+                    known_bits->defer_users(replacement);
+                }
+            }
+        }
+
+        if (known_bits != nullptr)
+        {
+            known_bits->flush();
+        }
+
+        return dag;
+    }
+} // namespace sbrt::passes::opt
@@ -0,0 +1,10 @@
+#include "pass/dce_pass.h"
+#include "instr/ir.h"
+#include <utility>
+
+auto sbrt::passes::opt::dead_node_elimination::transform(ir::ir_dag&& _dag) const -> result_t
+{
+    ir::ir_dag dag = std::move(_dag);
+    dag.erase_unreachable();
+    return dag;
+}
@@ -0,0 +1,106 @@
+#include "pass/gvn_pass.h"
+#include "instr/dag.h"
+#include "instr/ir.h"
+#include "pass/opt_util.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace sbrt::passes::opt
+{
+    namespace
+    {
+        auto is_commutative(ir::ir_opcode opcode) -> bool
+        {
+            return opcode == ir::ir_opcode::ADD || opcode == ir::ir_opcode::MUL || opcode == ir::ir_opcode::UMULH;
+        }
+
+        auto value_hash(const ir::ir_dag_node* node) -> size_t
+        {
+            size_t hash = detail::hash_bits(node->opcode);
+            hash = detail::hash_combine(hash, detail::hash_bits(node->type));
+            hash = detail::hash_combine(hash, detail::hash_bits(node->chain));
+            for (const auto* operand : node->operands)
+            {
+                hash = detail::hash_combine(hash, detail::hash_bits(operand));
+            }
+            for (const auto& value : node->imm)
+            {
+                hash = detail::hash_combine(hash, std::hash<ir::ir_imm_type>{}(value));
+            }
+            return hash;
+        }
+
+        auto value_equal(const ir::ir_dag_node* lhs, const ir::ir_dag_node* rhs) -> bool
+        {
+            return lhs->opcode == rhs->opcode && lhs->type == rhs->type && lhs->chain == rhs->chain &&
+                   std::ranges::equal(lhs->operands, rhs->operands) && std::ranges::equal(lhs->imm, rhs->imm);
+        }
+
+        void canonicalize(ir::ir_dag& dag, ir::ir_dag_node* node)
+        {
+            if (auto value = constant_of(node); value && std::get<uint64_t>(node->imm[0]) != *value)
+            {
+                dag.unhash_node(node);
+                node->imm[0] = *value;
+                dag.rehash_node(node);
+            }
+
+            if (!is_commutative(node->opcode) || node->operands.size() != 2)
+            {
+                return;
+            }
+
+            auto* lhs = node->operands[0];
+            auto* rhs = node->operands[1];
+            bool lhs_constant = lhs->opcode == ir::ir_opcode::IMM;
+            bool rhs_constant = rhs->opcode == ir::ir_opcode::IMM;
+            if ((lhs_constant && !rhs_constant) || (lhs_constant == rhs_constant && lhs->get_id() > rhs->get_id()))
+            {
+                // the use lists hold the node once per edge either way
+                dag.unhash_node(node);
+                std::swap(node->operands[0], node->operands[1]);
+                dag.rehash_node(node);
+            }
+        }
+    } // namespace
+
+    auto global_value_numbering::transform(ir::ir_dag&& _dag) const -> result_t
+    {
+        ir::ir_dag dag = std::move(_dag);
+
+        auto order = dag.post_order();
+        std::vector<ir::ir_dag_node*> table(std::bit_ceil(std::max<size_t>(16, order.size() * 2)));
+        size_t mask = table.size() - 1;
+
+        // post order sees operands first, so they already point at their leaders when a node is numbered
+        for (auto* node : order)
+        {
+            canonicalize(dag, node);
+            if (node->opcode == ir::ir_opcode::NONE || !filter(node))
+            {
+                continue;
+            }
+
+            size_t slot = value_hash(node) & mask;
+            while (table[slot] != nullptr && !value_equal(table[slot], node))
+            {
+                slot = (slot + 1) & mask;
+            }
+
+            if (table[slot] == nullptr)
+            {
+                table[slot] = node;
+            }
+            else
+            {
+                dag.replace_all_uses_with(node, table[slot]);
+            }
+        }
+
+        return dag;
+    }
+} // namespace sbrt::passes::opt
@@ -5,6 +5,29 @@
 #include <fmt/core.h>
 #include <utility>
 
+void sbrt::passes::isel::isel_ir_dag_check::check_type(ir::ir_types type) const
+{
+    if (!type.is_primitive())
+    {
+        error("Illegal non-primitive type in ISel DAG", submodule::ISEL).add_note("In pass " + pass_name()).do_throw();
+    }
+
+    switch (type.primitive())
+    {
+    case ir::ir_types::U8:
+    case ir::ir_types::U32:
+    case ir::ir_types::U16:
+    case ir::ir_types::U64:
+    case ir::ir_types::BOOL:
+    case ir::ir_types::PTR:
+        break;
+    default:
+        error(fmt::format("Illegal primitive type in ISel DAG {}", magic_enum::enum_name(type.primitive())), submodule::ISEL)
+            .add_note("In pass " + pass_name())
+            .do_throw();
+    }
+}
+
 auto sbrt::passes::isel::isel_ir_dag_check::transform(ir::ir_dag&& _dag) const -> result_t
 {
     ir::ir_dag dag = std::move(_dag);
@@ -12,26 +35,16 @@ auto sbrt::passes::isel::isel_ir_dag_check::transform(ir::ir_dag&& _dag) const -
     // validate types
     for (auto& node : dag.get_nodes())
     {
-        if (!node->type.is_primitive())
-        {
-            error("Illegal non-primitive type in ISel DAG", submodule::ISEL).add_note("In pass " + pass_name()).do_throw();
-        }
-
-        switch (node->type.primitive())
-        {
-        case ir::ir_types::U8:
-        case ir::ir_types::U32:
-        case ir::ir_types::U16:
-        case ir::ir_types::U64:
-        case ir::ir_types::BOOL:
-        case ir::ir_types::PTR:
-            break;
-        default:
-            error(fmt::format("Illegal primitive type in ISel DAG {}", magic_enum::enum_name(node->type.primitive())), submodule::ISEL)
-                .add_note("In pass " + pass_name())
-                .do_throw();
-        }
+        check_type(node->type);
     }
 
     return dag;
 }
+
+void sbrt::passes::isel::isel_ir_dag_check::check(const ir::ir_dense_dag& dag) const
+{
+    for (auto type : dag.get_types())
+    {
+        check_type(type);
+    }
+}
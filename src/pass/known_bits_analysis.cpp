@@ -0,0 +1,420 @@
+#include "pass/known_bits_analysis.h"
+#include "instr/ir.h"
+#include "pass/analysis.h"
+#include "pass/opt_util.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <vector>
+
+namespace sbrt::passes::opt
+{
+    namespace
+    {
+        using i128 = __int128;
+        using u128 = unsigned __int128;
+
+        auto signed_min(size_t bits) -> int64_t { return sign_extend(uint64_t{1} << (bits - 1), bits); }
+        auto signed_max(size_t bits) -> int64_t { return static_cast<int64_t>(width_mask(bits - 1)); }
+
+        auto width_of(ir::ir_types type) -> size_t
+        {
+            size_t bits = type.bit_width();
+            return bits == 0 ? 64 : bits;
+        }
+
+        /**
+         * Floor of `value / 2^bits`, for any sign
+         */
+        auto wraps_of(i128 value, size_t bits) -> i128
+        {
+            i128 modulus = i128{1} << bits;
+            return value >= 0 ? value / modulus : -((-value + modulus - 1) / modulus);
+        }
+
+        /**
+         * Narrows the unsigned range to the exact range [lo, hi] taken modulo 2^bits, if it does not straddle a wrap
+         */
+        void set_unsigned(value_facts& facts, i128 lo, i128 hi, size_t bits)
+        {
+            i128 offset = wraps_of(lo, bits) << bits;
+            if (hi - offset <= static_cast<i128>(width_mask(bits)))
+            {
+                facts.umin = static_cast<uint64_t>(lo - offset);
+                facts.umax = static_cast<uint64_t>(hi - offset);
+            }
+        }
+
+        void set_signed(value_facts& facts, i128 lo, i128 hi, size_t bits)
+        {
+            i128 bias = i128{1} << (bits - 1);
+            i128 offset = wraps_of(lo + bias, bits) << bits;
+            if (hi + bias - offset <= static_cast<i128>(width_mask(bits)))
+            {
+                facts.smin = static_cast<int64_t>(lo - offset);
+                facts.smax = static_cast<int64_t>(hi - offset);
+            }
+        }
+
+        /**
+         * Known bits of lhs + rhs + carry, where the carry in is known; rhs is given as masks so that subtraction can
+         * pass the complement
+         */
+        void add_bits(value_facts& out, const value_facts& lhs, uint64_t rhs_zero, uint64_t rhs_one, uint64_t carry, size_t bits)
+        {
+            uint64_t mask = width_mask(bits);
+            uint64_t possible_zero = ((~lhs.known_zero & mask) + (~rhs_zero & mask) + carry) & mask;
+            uint64_t possible_one = (lhs.known_one + rhs_one + carry) & mask;
+
+            uint64_t carry_known_zero = ~(possible_zero ^ lhs.known_zero ^ rhs_zero) & mask;
+            uint64_t carry_known_one = (possible_one ^ lhs.known_one ^ rhs_one) & mask;
+            uint64_t known = lhs.known_mask() & (rhs_zero | rhs_one) & (carry_known_zero | carry_known_one);
+
+            out.known_zero = ~possible_zero & known;
+            out.known_one = possible_one & known;
+        }
+
+        void mul_bits(value_facts& out, const value_facts& lhs, const value_facts& rhs, size_t bits)
+        {
+            // the low k bits of a product only depend on the low k bits of the operands
+            auto low_known = std::min<size_t>({bits, static_cast<size_t>(std::countr_one(lhs.known_mask())),
+                                               static_cast<size_t>(std::countr_one(rhs.known_mask()))});
+            uint64_t low = width_mask(low_known);
+            uint64_t product = lhs.known_one * rhs.known_one;
+
+            auto trailing_zeros = std::min<size_t>(bits, std::countr_one(lhs.known_zero) + std::countr_one(rhs.known_zero));
+
+            out.known_zero = (~product & low) | width_mask(trailing_zeros);
+            out.known_one = product & low;
+        }
+
+        void shift_facts(value_facts& out, ir::ir_opcode opcode, const value_facts& value, size_t amount, size_t bits)
+        {
+            uint64_t mask = width_mask(bits);
+            switch (opcode)
+            {
+            case ir::ir_opcode::SHL:
+                out.known_zero = ((value.known_zero << amount) | width_mask(amount)) & mask;
+                out.known_one = (value.known_one << amount) & mask;
+                set_unsigned(out, static_cast<i128>(value.umin) << amount, static_cast<i128>(value.umax) << amount, bits);
+                set_signed(out, static_cast<i128>(value.smin) * (i128{1} << amount), static_cast<i128>(value.smax) * (i128{1} << amount), bits);
+                break;
+            case ir::ir_opcode::LSHR:
+                out.known_zero = (value.known_zero >> amount) | (mask & ~(mask >> amount));
+                out.known_one = value.known_one >> amount;
+                out.umin = value.umin >> amount;
+                out.umax = value.umax >> amount;
+                break;
+            case ir::ir_opcode::ASHR:
+                out.known_zero = static_cast<uint64_t>(sign_extend(value.known_zero, bits) >> amount) & mask;
+                out.known_one = static_cast<uint64_t>(sign_extend(value.known_one, bits) >> amount) & mask;
+                out.smin = value.smin >> amount;
+                out.smax = value.smax >> amount;
+                break;
+            default:
+                break;
+            }
+        }
+
+        /**
+         * Carries what each part implies over to the others. Contradicting parts only come from code that always
+         * traps, and are dropped.
+         */
+        auto refine(value_facts facts, size_t bits) -> value_facts
+        {
+            uint64_t mask = width_mask(bits);
+            uint64_t sign = uint64_t{1} << (bits - 1);
+
+            facts.umin = std::max(facts.umin, facts.known_one);
+            facts.umax = std::min(facts.umax, ~facts.known_zero & mask);
+
+            if (facts.smin >= 0 || facts.smax < 0)
+            {
+                facts.umin = std::max(facts.umin, static_cast<uint64_t>(facts.smin) & mask);
+                facts.umax = std::min(facts.umax, static_cast<uint64_t>(facts.smax) & mask);
+            }
+
+            if (facts.umin > facts.umax)
+            {
+                return value_facts::unknown(bits);
+            }
+
+            if (facts.umax < sign || facts.umin >= sign)
+            {
+                facts.smin = std::max(facts.smin, sign_extend(facts.umin, bits));
+                facts.smax = std::min(facts.smax, sign_extend(facts.umax, bits));
+            }
+
+            if (facts.smin > facts.smax)
+            {
+                return value_facts::unknown(bits);
+            }
+
+            // bits above the highest one where umin and umax differ are shared by every value in between
+            uint64_t prefix = mask & ~width_mask(std::bit_width(facts.umin ^ facts.umax));
+            facts.known_zero |= ~facts.umin & prefix;
+            facts.known_one |= facts.umin & prefix;
+
+            return facts;
+        }
+
+        auto transfer(const ir::ir_dag_node* node, const value_facts& lhs, const value_facts& rhs, size_t bits) -> value_facts
+        {
+            if (lhs.is_constant() && rhs.is_constant())
+            {
+                auto value = evaluate(node->opcode, lhs.umin, rhs.umin, bits);
+                return value ? value_facts::constant(*value, bits) : value_facts::unknown(bits);
+            }
+
+            auto out = value_facts::unknown(bits);
+            switch (node->opcode)
+            {
+            case ir::ir_opcode::ADD:
+                add_bits(out, lhs, rhs.known_zero, rhs.known_one, 0, bits);
+                set_unsigned(out, i128{lhs.umin} + rhs.umin, i128{lhs.umax} + rhs.umax, bits);
+                set_signed(out, i128{lhs.smin} + rhs.smin, i128{lhs.smax} + rhs.smax, bits);
+                break;
+            case ir::ir_opcode::SUB:
+                // lhs + ~rhs + 1
+                add_bits(out, lhs, rhs.known_one, rhs.known_zero, 1, bits);
+                set_unsigned(out, i128{lhs.umin} - rhs.umax, i128{lhs.umax} - rhs.umin, bits);
+                set_signed(out, i128{lhs.smin} - rhs.smax, i128{lhs.smax} - rhs.smin, bits);
+                break;
+            case ir::ir_opcode::MUL: {
+                mul_bits(out, lhs, rhs, bits);
+                if (u128{lhs.umax} * rhs.umax < (u128{1} << 127))
+                {
+                    set_unsigned(out, i128{lhs.umin} * rhs.umin, i128{lhs.umax} * rhs.umax, bits);
+                }
+                i128 corners[] = {i128{lhs.smin} * rhs.smin, i128{lhs.smin} * rhs.smax, i128{lhs.smax} * rhs.smin, i128{lhs.smax} * rhs.smax};
+                set_signed(out, *std::ranges::min_element(corners), *std::ranges::max_element(corners), bits);
+                break;
+            }
+            case ir::ir_opcode::UDIV:
+                if (rhs.umax != 0)
+                {
+                    out.umin = lhs.umin / rhs.umax;
+                    out.umax = lhs.umax / std::max<uint64_t>(rhs.umin, 1);
+                }
+                break;
+            case ir::ir_opcode::SDIV:
+                if (lhs.smin >= 0 && rhs.smin > 0)
+                {
+                    out.smin = lhs.smin / rhs.smax;
+                    out.smax = lhs.smax / rhs.smin;
+                }
+                else if (rhs.is_constant() && (rhs.smin > 0 || rhs.smin < -1))
+                {
+                    // truncating division by a constant is monotonic in the dividend
+                    int64_t lo = lhs.smin / rhs.smin;
+                    int64_t hi = lhs.smax / rhs.smin;
+                    out.smin = std::min(lo, hi);
+                    out.smax = std::max(lo, hi);
+                }
+                break;
+            case ir::ir_opcode::SHL:
+            case ir::ir_opcode::LSHR:
+            case ir::ir_opcode::ASHR:
+                if (rhs.is_constant() && rhs.umin < bits)
+                {
+                    shift_facts(out, node->opcode, lhs, rhs.umin, bits);
+                }
+                break;
+            case ir::ir_opcode::UMULH:
+                out.umin = static_cast<uint64_t>((u128{lhs.umin} * rhs.umin) >> bits);
+                out.umax = static_cast<uint64_t>((u128{lhs.umax} * rhs.umax) >> bits);
+                break;
+            default:
+                break;
+            }
+
+            return refine(out, bits);
+        }
+    } // namespace
+
+    auto value_facts::unknown(size_t bits) -> value_facts { return {0, 0, 0, width_mask(bits), signed_min(bits), signed_max(bits)}; }
+
+    auto value_facts::constant(uint64_t value, size_t bits) -> value_facts
+    {
+        uint64_t mask = width_mask(bits);
+        value &= mask;
+        return {~value & mask, value, value, value, sign_extend(value, bits), sign_extend(value, bits)};
+    }
+
+    known_bits_analysis::known_bits_analysis(ir::ir_dag& dag, analysis_manager<ir::ir_dag>& /*analyses*/)
+        : facts(dag.max_node_id()), computed(dag.max_node_id())
+    {
+        for (auto* node : dag.get_nodes())
+        {
+            ensure(node);
+        }
+    }
+
+    void known_bits_analysis::compute(ir::ir_dag_node* node)
+    {
+        size_t bits = width_of(node->type);
+        size_t id = node->get_id();
+        if (id >= facts.size())
+        {
+            facts.resize(id + 1);
+            computed.resize(id + 1);
+        }
+
+        auto operand_facts = [&](size_t index) {
+            auto* operand = node->operands[index];
+            // a width mismatch would be an ill-typed dag, and tells nothing
+            return operand->type == node->type ? facts[operand->get_id()] : value_facts::unknown(bits);
+        };
+
+        if (auto value = constant_of(node))
+        {
+            facts[id] = value_facts::constant(*value, bits);
+        }
+        else if (node->operands.size() == 2 && node->type.bit_width() != 0)
+        {
+            facts[id] = transfer(node, operand_facts(0), operand_facts(1), bits);
+        }
+        else
+        {
+            facts[id] = value_facts::unknown(bits);
+        }
+
+        computed[id] = true;
+    }
+
+    void known_bits_analysis::ensure(ir::ir_dag_node* node)
+    {
+        auto is_computed = [this](const ir::ir_dag_node* node) { return node->get_id() < computed.size() && computed[node->get_id()]; };
+
+        if (is_computed(node))
+        {
+            return;
+        }
+
+        stack.clear();
+        stack.push_back(node);
+        while (!stack.empty())
+        {
+            auto* curr = stack.back();
+            bool ready = true;
+            for (auto* operand : curr->operands)
+            {
+                if (!is_computed(operand))
+                {
+                    stack.push_back(operand);
+                    ready = false;
+                }
+            }
+
+            if (ready)
+            {
+                stack.pop_back();
+                if (!is_computed(curr))
+                {
+                    compute(curr);
+                }
+            }
+        }
+    }
+
+    auto known_bits_analysis::recompute(ir::ir_dag_node* node) -> bool
+    {
+        for (auto* operand : node->operands)
+        {
+            ensure(operand);
+        }
+
+        size_t id = node->get_id();
+        bool fresh = id >= computed.size() || !computed[id];
+        auto old = fresh ? value_facts{} : facts[id];
+        compute(node);
+        return fresh || facts[id] != old;
+    }
+
+    auto known_bits_analysis::of(ir::ir_dag_node* node) -> const value_facts&
+    {
+        ensure(node);
+        return facts[node->get_id()];
+    }
+
+    void known_bits_analysis::update(ir::ir_dag_node* node) { update(std::span(&node, 1)); }
+
+    void known_bits_analysis::update(std::span<ir::ir_dag_node* const> nodes)
+    {
+        auto enter = [this](ir::ir_dag_node* node) {
+            size_t id = node->get_id();
+            if (id >= in_cone.size())
+            {
+                in_cone.resize(id + 1);
+                dirty.resize(id + 1);
+            }
+
+            bool fresh = !in_cone[id];
+            in_cone[id] = true;
+            return fresh;
+        };
+
+        // the cone above the changed nodes, in post order along user edges, so each node lands after all its users
+        for (auto* node : nodes)
+        {
+            bool fresh = enter(node);
+            dirty[node->get_id()] = true;
+            if (!fresh)
+            {
+                continue;
+            }
+
+            walk.emplace_back(node, 0);
+            while (!walk.empty())
+            {
+                auto* curr = walk.back().first;
+                size_t next = walk.back().second++;
+                if (next < curr->get_users().size())
+                {
+                    auto* user = curr->get_users()[next];
+                    if (enter(user))
+                    {
+                        walk.emplace_back(user, 0);
+                    }
+                }
+                else
+                {
+                    cone.push_back(curr);
+                    walk.pop_back();
+                }
+            }
+        }
+
+        // reversed, operands come before their users, so every node is recomputed once with final operand facts; the
+        // ones none of whose operands changed are skipped
+        for (auto* node : std::views::reverse(cone))
+        {
+            if (dirty[node->get_id()] && recompute(node))
+            {
+                for (auto* user : node->get_users())
+                {
+                    dirty[user->get_id()] = true;
+                }
+            }
+        }
+
+        for (auto* node : cone)
+        {
+            in_cone[node->get_id()] = false;
+            dirty[node->get_id()] = false;
+        }
+        cone.clear();
+    }
+
+    void known_bits_analysis::update_users(ir::ir_dag_node* node) { update(node->get_users()); }
+
+    void known_bits_analysis::flush()
+    {
+        update(deferred);
+        deferred.clear();
+    }
+} // namespace sbrt::passes::opt
@@ -0,0 +1,56 @@
+#include "pass/opt_util.h"
+#include "instr/ir.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace sbrt::passes::opt
+{
+    namespace
+    {
+        auto evaluate_unmasked(ir::ir_opcode opcode, uint64_t lhs, uint64_t rhs, size_t bits) -> std::optional<uint64_t>
+        {
+            switch (opcode)
+            {
+            case ir::ir_opcode::ADD:
+                return lhs + rhs;
+            case ir::ir_opcode::SUB:
+                return lhs - rhs;
+            case ir::ir_opcode::MUL:
+                return lhs * rhs;
+            case ir::ir_opcode::UDIV:
+                if (rhs == 0)
+                {
+                    return std::nullopt;
+                }
+                return lhs / rhs;
+            case ir::ir_opcode::SDIV: {
+                int64_t dividend = sign_extend(lhs, bits);
+                int64_t divisor = sign_extend(rhs, bits);
+                // the second case is INT_MIN / -1 of the width, which traps as well
+                if (divisor == 0 || (divisor == -1 && lhs == (uint64_t{1} << (bits - 1))))
+                {
+                    return std::nullopt;
+                }
+                return static_cast<uint64_t>(dividend / divisor);
+            }
+            case ir::ir_opcode::SHL:
+                return rhs < bits ? std::optional(lhs << rhs) : std::nullopt;
+            case ir::ir_opcode::LSHR:
+                return rhs < bits ? std::optional(lhs >> rhs) : std::nullopt;
+            case ir::ir_opcode::ASHR:
+                return rhs < bits ? std::optional(static_cast<uint64_t>(sign_extend(lhs, bits) >> rhs)) : std::nullopt;
+            case ir::ir_opcode::UMULH:
+                return static_cast<uint64_t>((static_cast<unsigned __int128>(lhs) * rhs) >> bits);
+            default:
+                return std::nullopt;
+            }
+        }
+    } // namespace
+
+    auto evaluate(ir::ir_opcode opcode, uint64_t lhs, uint64_t rhs, size_t bits) -> std::optional<uint64_t>
+    {
+        auto value = evaluate_unmasked(opcode, lhs & width_mask(bits), rhs & width_mask(bits), bits);
+        return value ? std::optional(*value & width_mask(bits)) : std::nullopt;
+    }
+} // namespace sbrt::passes::opt
@@ -0,0 +1,133 @@
+#include "pass/pass_statistics.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <fmt/core.h>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sbrt
+{
+    namespace
+    {
+        auto as_ms(std::chrono::nanoseconds time) -> double { return std::chrono::duration<double, std::milli>(time).count(); }
+
+        auto signed_delta(uint64_t before, uint64_t after) -> int64_t { return static_cast<int64_t>(after) - static_cast<int64_t>(before); }
+
+        void write_json_string(std::ostream& out, std::string_view str)
+        {
+            out << '"';
+            for (char ch : str)
+            {
+                if (ch == '"' || ch == '\\')
+                {
+                    out << '\\' << ch;
+                }
+                else if (static_cast<unsigned char>(ch) < 0x20)
+                {
+                    out << fmt::format("\\u{:04x}", static_cast<unsigned>(ch));
+                }
+                else
+                {
+                    out << ch;
+                }
+            }
+            out << '"';
+        }
+    } // namespace
+
+    auto pass_statistics::thread_cpu_time() -> std::chrono::nanoseconds
+    {
+        timespec time{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+    }
+
+    void pass_statistics::record(std::string_view name, const pass_sample& sample)
+    {
+        std::lock_guard lock(mutex);
+
+        auto it = std::ranges::find(entries, name, &entry::name);
+        if (it == entries.end())
+        {
+            it = entries.insert(entries.end(), entry{.name = std::string(name)});
+        }
+
+        it->runs++;
+        it->wall += sample.wall;
+        it->cpu += sample.cpu;
+
+        if (sample.failed)
+        {
+            it->failures++;
+        }
+        else
+        {
+            it->nodes_before += sample.before.nodes;
+            it->dag_bytes_before += sample.before.dag_bytes;
+            it->nodes_after += sample.after.nodes;
+            it->dag_bytes_after += sample.after.dag_bytes;
+        }
+    }
+
+    auto pass_statistics::snapshot() const -> std::vector<entry>
+    {
+        std::lock_guard lock(mutex);
+        return entries;
+    }
+
+    void pass_statistics::clear()
+    {
+        std::lock_guard lock(mutex);
+        entries.clear();
+    }
+
+    void pass_statistics::dump_table(std::ostream& out) const
+    {
+        auto copy = snapshot();
+
+        size_t name_width = 4;
+        for (const auto& entry : copy)
+        {
+            name_width = std::max(name_width, entry.name.size());
+        }
+
+        out << fmt::format(
+            "{:<{}}  {:>8}  {:>6}  {:>12}  {:>12}  {:>12}  {:>12}  {:>15}\n", "pass", name_width, "runs", "fail", "wall ms", "cpu ms",
+            "nodes in", "nodes delta", "dag bytes delta"
+        );
+
+        for (const auto& entry : copy)
+        {
+            out << fmt::format(
+                "{:<{}}  {:>8}  {:>6}  {:>12.3f}  {:>12.3f}  {:>12}  {:>12}  {:>15}\n", entry.name, name_width, entry.runs, entry.failures,
+                as_ms(entry.wall), as_ms(entry.cpu), entry.nodes_before, signed_delta(entry.nodes_before, entry.nodes_after),
+                signed_delta(entry.dag_bytes_before, entry.dag_bytes_after)
+            );
+        }
+    }
+
+    void pass_statistics::dump_json(std::ostream& out) const
+    {
+        auto copy = snapshot();
+
+        out << '[';
+        for (size_t i = 0; i < copy.size(); i++)
+        {
+            const auto& entry = copy[i];
+            out << (i == 0 ? "\n  {" : ",\n  {") << "\"name\": ";
+            write_json_string(out, entry.name);
+            out << fmt::format(
+                ", \"runs\": {}, \"failures\": {}, \"wall_ns\": {}, \"cpu_ns\": {}, \"nodes_before\": {}, \"nodes_after\": {}, "
+                "\"dag_bytes_before\": {}, \"dag_bytes_after\": {}}}",
+                entry.runs, entry.failures, entry.wall.count(), entry.cpu.count(), entry.nodes_before, entry.nodes_after,
+                entry.dag_bytes_before, entry.dag_bytes_after
+            );
+        }
+        out << (copy.empty() ? "]\n" : "\n]\n");
+    }
+} // namespace sbrt
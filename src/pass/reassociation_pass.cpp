@@ -0,0 +1,393 @@
+#include "pass/reassociation_pass.h"
+#include "instr/ir.h"
+#include "pass/opt_util.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace sbrt::passes::opt
+{
+    namespace
+    {
+        struct term
+        {
+            ir::ir_dag_node* leaf;
+            uint64_t coefficient;
+        };
+
+        /**
+         * The constant operand of a MUL and the other one, if it has one
+         */
+        auto scaled_operand(const ir::ir_dag_node* node) -> std::optional<std::pair<ir::ir_dag_node*, uint64_t>>
+        {
+            if (auto factor = constant_of(node->operands[1]))
+            {
+                return std::pair(node->operands[0], *factor);
+            }
+            if (auto factor = constant_of(node->operands[0]))
+            {
+                return std::pair(node->operands[1], *factor);
+            }
+            return std::nullopt;
+        }
+
+        /**
+         * Whether `node` takes part in a linear tree of its type at all
+         */
+        auto is_linear(const ir::ir_dag_node* node, ir::ir_types type) -> bool
+        {
+            if (node->type != type || node->chain != nullptr || node->operands.size() != 2)
+            {
+                return false;
+            }
+
+            switch (node->opcode)
+            {
+            case ir::ir_opcode::ADD:
+            case ir::ir_opcode::SUB:
+                return true;
+            case ir::ir_opcode::MUL:
+                return scaled_operand(node).has_value();
+            default:
+                return false;
+            }
+        }
+
+        /**
+         * Rough latency of an instruction, a multiply costing about three adds
+         */
+        constexpr auto weight_of(ir::ir_opcode opcode) -> size_t { return opcode == ir::ir_opcode::MUL ? 3 : 1; }
+
+        /**
+         * Tracks which nodes are still reachable: the dag keeps the uses of dead nodes until dce, and those must not
+         * keep a subtree from being folded into its only live user
+         */
+        class liveness
+        {
+            std::vector<bool> live;
+
+        public:
+            void reset(std::span<ir::ir_dag_node* const> order, size_t node_count)
+            {
+                live.assign(node_count, false);
+                for (auto* node : order)
+                {
+                    live[node->get_id()] = true;
+                }
+            }
+
+            // nodes created during the pass are live until they are killed
+            [[nodiscard]] auto is_live(const ir::ir_dag_node* node) const -> bool { return node->get_id() >= live.size() || live[node->get_id()]; }
+
+            void kill(const ir::ir_dag_node* node)
+            {
+                if (node->get_id() < live.size())
+                {
+                    live[node->get_id()] = false;
+                }
+            }
+
+            /**
+             * The only live user of `node`, if it has exactly one use from a live node
+             */
+            auto only_user(const ir::ir_dag_node* node) const -> ir::ir_dag_node*
+            {
+                ir::ir_dag_node* result = nullptr;
+                for (auto* user : node->get_users())
+                {
+                    if (is_live(user))
+                    {
+                        if (result != nullptr)
+                        {
+                            return nullptr;
+                        }
+                        result = user;
+                    }
+                }
+                return result;
+            }
+
+            /**
+             * Whether `node` is folded into the tree of its only user rather than being the root of a tree of its own
+             */
+            auto is_absorbed(const ir::ir_dag_node* node) const -> bool
+            {
+                auto* user = only_user(node);
+                if (user == nullptr || !is_linear(user, node->type))
+                {
+                    return false;
+                }
+
+                // a MUL only absorbs its scaled operand, never its constant
+                return user->opcode != ir::ir_opcode::MUL || scaled_operand(user)->first == node;
+            }
+        };
+
+        class linear_form
+        {
+            size_t bits;
+            uint64_t mask;
+
+            // scratch, reused across trees
+            std::vector<std::pair<ir::ir_dag_node*, uint64_t>> stack;
+            std::vector<term> occurrences;
+            std::vector<term> terms;
+            std::vector<ir::ir_dag_node*> interior;
+
+            uint64_t constant = 0;
+            size_t constants = 0;
+            // index into occurrences at which the last constant was seen
+            size_t constant_position = 0;
+
+            [[nodiscard]] auto is_negated(const term& curr) const -> bool { return curr.coefficient == mask; }
+            // doubling is x + x, and -x a subtraction
+            [[nodiscard]] auto needs_multiply(const term& curr) const -> bool { return curr.coefficient != 1 && curr.coefficient != 2 && !is_negated(curr); }
+            [[nodiscard]] auto order_key(const term& curr) const { return std::tuple(is_negated(curr), curr.leaf->get_id()); }
+
+        public:
+            void collect(ir::ir_dag_node* root, const liveness& nodes)
+            {
+                bits = root->type.bit_width();
+                mask = width_mask(bits);
+                occurrences.clear();
+                constant = 0;
+                constants = 0;
+                interior.clear();
+
+                stack.clear();
+                stack.emplace_back(root, 1);
+                while (!stack.empty())
+                {
+                    auto [node, coefficient] = stack.back();
+                    stack.pop_back();
+
+                    if (auto value = constant_of(node); value && node->type == root->type)
+                    {
+                        constant = (constant + coefficient * *value) & mask;
+                        constants++;
+                        constant_position = occurrences.size();
+                        continue;
+                    }
+
+                    if ((node != root && !nodes.is_absorbed(node)) || !is_linear(node, root->type))
+                    {
+                        occurrences.push_back({node, coefficient});
+                        continue;
+                    }
+
+                    interior.push_back(node);
+                    // pushed right to left, so that the leaves come out in the order they appear in
+                    switch (node->opcode)
+                    {
+                    case ir::ir_opcode::ADD:
+                        stack.emplace_back(node->operands[1], coefficient);
+                        stack.emplace_back(node->operands[0], coefficient);
+                        break;
+                    case ir::ir_opcode::SUB:
+                        stack.emplace_back(node->operands[1], (0 - coefficient) & mask);
+                        stack.emplace_back(node->operands[0], coefficient);
+                        break;
+                    default: {
+                        auto [scaled, factor] = *scaled_operand(node);
+                        stack.emplace_back(scaled, (coefficient * factor) & mask);
+                        break;
+                    }
+                    }
+                }
+
+                terms = occurrences;
+                std::ranges::stable_sort(terms, {}, [](const term& curr) { return curr.leaf->get_id(); });
+                size_t merged = 0;
+                for (const auto& curr : terms)
+                {
+                    if (merged != 0 && terms[merged - 1].leaf == curr.leaf)
+                    {
+                        terms[merged - 1].coefficient = (terms[merged - 1].coefficient + curr.coefficient) & mask;
+                    }
+                    else
+                    {
+                        terms[merged++] = curr;
+                    }
+                }
+                terms.resize(merged);
+                std::erase_if(terms, [](const term& curr) { return curr.coefficient == 0; });
+                std::ranges::stable_sort(terms, {}, [this](const term& curr) { return order_key(curr); });
+            }
+
+            /**
+             * Weight of what build() creates, not counting IMMs
+             */
+            [[nodiscard]] auto cost() const -> size_t
+            {
+                if (terms.empty())
+                {
+                    return 0;
+                }
+
+                size_t result = (terms.size() - 1) * weight_of(ir::ir_opcode::ADD);
+                for (const auto& curr : terms)
+                {
+                    if (needs_multiply(curr))
+                    {
+                        result += weight_of(ir::ir_opcode::MUL);
+                    }
+                    else if (curr.coefficient == 2)
+                    {
+                        result += weight_of(ir::ir_opcode::ADD);
+                    }
+                }
+
+                // the constant, or a negation of the first term when everything is subtracted
+                return result + (constant != 0 || is_negated(terms.front()) ? weight_of(ir::ir_opcode::SUB) : 0);
+            }
+
+            /**
+             * MULs build() creates
+             */
+            [[nodiscard]] auto multiplies() const -> size_t { return std::ranges::count_if(terms, [this](const term& curr) { return needs_multiply(curr); }); }
+
+            /**
+             * The ADD, SUB and MUL nodes of the tree, root included
+             */
+            [[nodiscard]] auto interior_nodes() const -> std::span<ir::ir_dag_node* const> { return interior; }
+
+            /**
+             * Whether the tree already has the shape build() would give it
+             */
+            [[nodiscard]] auto is_canonical() const -> bool
+            {
+                // a leading subtraction is from the constant, even if it is 0
+                bool leading = !terms.empty() && is_negated(terms.front());
+                if (constants > (constant != 0 || leading ? 1 : 0))
+                {
+                    return false;
+                }
+
+                size_t position = 0;
+                for (const auto& curr : terms)
+                {
+                    // a doubled leaf is built as x + x, which reads back as two occurrences
+                    size_t copies = curr.coefficient == 2 ? 2 : 1;
+                    uint64_t coefficient = copies == 2 ? 1 : curr.coefficient;
+                    for (size_t i = 0; i < copies; i++, position++)
+                    {
+                        if (position >= occurrences.size() || occurrences[position].leaf != curr.leaf ||
+                            occurrences[position].coefficient != coefficient)
+                        {
+                            return false;
+                        }
+                    }
+                }
+
+                return position == occurrences.size() && (constants == 0 || constant_position == (leading ? 0 : occurrences.size()));
+            }
+
+            auto build(ir::ir_dag& dag, ir::ir_types type) -> ir::ir_dag_node*
+            {
+                auto make_constant = [&](uint64_t value) { return dag.create(nullptr, ir::ir_opcode::IMM, type, ir::ir_imm_type(value)); };
+                auto make = [&](ir::ir_opcode opcode, ir::ir_dag_node* lhs, ir::ir_dag_node* rhs) {
+                    return dag.create(nullptr, opcode, type, lhs, rhs);
+                };
+
+                ir::ir_dag_node* value = nullptr;
+                bool constant_used = false;
+                for (const auto& curr : terms)
+                {
+                    bool negated = is_negated(curr);
+                    auto* operand = curr.leaf;
+                    if (curr.coefficient == 2)
+                    {
+                        operand = make(ir::ir_opcode::ADD, curr.leaf, curr.leaf);
+                    }
+                    else if (needs_multiply(curr))
+                    {
+                        operand = make(ir::ir_opcode::MUL, curr.leaf, make_constant(curr.coefficient));
+                    }
+
+                    if (value == nullptr)
+                    {
+                        value = negated ? make(ir::ir_opcode::SUB, make_constant(constant), operand) : operand;
+                        constant_used = negated;
+                    }
+                    else
+                    {
+                        value = make(negated ? ir::ir_opcode::SUB : ir::ir_opcode::ADD, value, operand);
+                    }
+                }
+
+                if (value == nullptr)
+                {
+                    return make_constant(constant);
+                }
+
+                if (!constant_used && constant != 0)
+                {
+                    // x - 2 reads better than x + 0xfffffffe, and encodes the same
+                    bool subtract = sign_extend(constant, bits) < 0 && constant != (uint64_t{1} << (bits - 1));
+                    value = subtract ? make(ir::ir_opcode::SUB, value, make_constant((0 - constant) & mask))
+                                     : make(ir::ir_opcode::ADD, value, make_constant(constant));
+                }
+
+                return value;
+            }
+        };
+    } // namespace
+
+    auto reassociation::transform(ir::ir_dag&& _dag) const -> result_t
+    {
+        ir::ir_dag dag = std::move(_dag);
+        linear_form form;
+        liveness nodes;
+
+        // a rewrite drops uses further down, which can let a tree that was already visited absorb more nodes, so the
+        // walk is repeated until nothing changes
+        bool changed = true;
+        for (size_t round = 0; changed && round < MAX_ROUNDS; round++)
+        {
+            changed = false;
+            auto order = dag.post_order();
+            nodes.reset(order, dag.max_node_id());
+
+            for (auto* node : order)
+            {
+                if (node->type.bit_width() == 0 || !nodes.is_live(node) || !is_linear(node, node->type) || nodes.is_absorbed(node))
+                {
+                    continue;
+                }
+
+                form.collect(node, nodes);
+                size_t cost = form.cost();
+                size_t existing = 0;
+                size_t existing_multiplies = 0;
+                for (auto* interior : form.interior_nodes())
+                {
+                    existing += weight_of(interior->opcode);
+                    existing_multiplies += interior->opcode == ir::ir_opcode::MUL ? 1 : 0;
+                }
+
+                // a MUL the tree did not have may not be selectable, and is never cheaper than what it replaces
+                if (form.multiplies() > existing_multiplies)
+                {
+                    continue;
+                }
+
+                if (cost < existing || (cost == existing && !form.is_canonical()))
+                {
+                    dag.replace_all_uses_with(node, form.build(dag, node->type));
+                    for (auto* dead : form.interior_nodes())
+                    {
+                        nodes.kill(dead);
+                    }
+                    changed = true;
+                }
+            }
+        }
+
+        return dag;
+    }
+} // namespace sbrt::passes::opt
@@ -0,0 +1,177 @@
+#include "pass/strength_reduction_pass.h"
+#include "instr/ir.h"
+#include "pass/opt_util.h"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+namespace sbrt::passes::opt
+{
+    auto unsigned_magic_for(uint64_t divisor, size_t bits) -> unsigned_magic
+    {
+        using u128 = unsigned __int128;
+
+        // ceil(log2(divisor))
+        auto log = static_cast<size_t>(std::bit_width(divisor - 1));
+
+        // round-up method: m = ceil(2^(bits + s) / d) is exact when m * d - 2^(bits + s) <= 2^s (Granlund-Montgomery,
+        // theorem 4.2), and for s = log the multiplier no longer fits in the width
+        for (size_t shift = 0; shift < log; shift++)
+        {
+            u128 power = u128{1} << (bits + shift);
+            u128 multiplier = (power + divisor - 1) / divisor;
+            if (multiplier <= width_mask(bits) && multiplier * divisor - power <= (u128{1} << shift))
+            {
+                return {static_cast<uint64_t>(multiplier), shift, false};
+            }
+        }
+
+        // the multiplier needs bits + 1 bits; its top bit is folded back in with the add
+        u128 multiplier = ((u128{1} << bits) * ((u128{1} << log) - divisor)) / divisor + 1;
+        return {static_cast<uint64_t>(multiplier), log - 1, true};
+    }
+
+    namespace
+    {
+        class reducer
+        {
+            ir::ir_dag& dag;
+            ir::ir_types type;
+            size_t bits;
+
+            auto constant(uint64_t value) -> ir::ir_dag_node* { return dag.create(nullptr, ir::ir_opcode::IMM, type, ir::ir_imm_type(value)); }
+
+            auto binary(ir::ir_opcode opcode, ir::ir_dag_node* lhs, ir::ir_dag_node* rhs) -> ir::ir_dag_node*
+            {
+                return dag.create(nullptr, opcode, type, lhs, rhs);
+            }
+
+            auto shift(ir::ir_opcode opcode, ir::ir_dag_node* value, size_t amount) -> ir::ir_dag_node*
+            {
+                return amount == 0 ? value : binary(opcode, value, constant(amount));
+            }
+
+        public:
+            reducer(ir::ir_dag& dag, ir::ir_types type) : dag(dag), type(type), bits(type.bit_width()) {}
+
+            auto multiply(ir::ir_dag_node* value, uint64_t factor) -> ir::ir_dag_node*
+            {
+                if (factor == width_mask(bits))
+                {
+                    return binary(ir::ir_opcode::SUB, constant(0), value);
+                }
+
+                if (std::has_single_bit(factor))
+                {
+                    return shift(ir::ir_opcode::SHL, value, std::countr_zero(factor));
+                }
+
+                if (std::popcount(factor) == 2)
+                {
+                    auto low = static_cast<size_t>(std::countr_zero(factor));
+                    auto high = static_cast<size_t>(std::bit_width(factor) - 1);
+                    return binary(ir::ir_opcode::ADD, shift(ir::ir_opcode::SHL, value, high), shift(ir::ir_opcode::SHL, value, low));
+                }
+
+                if (std::has_single_bit(factor + 1))
+                {
+                    return binary(ir::ir_opcode::SUB, shift(ir::ir_opcode::SHL, value, std::countr_zero(factor + 1)), value);
+                }
+
+                return nullptr;
+            }
+
+            auto divide_unsigned(ir::ir_dag_node* value, uint64_t divisor) -> ir::ir_dag_node*
+            {
+                if (std::has_single_bit(divisor))
+                {
+                    return shift(ir::ir_opcode::LSHR, value, std::countr_zero(divisor));
+                }
+
+                auto magic = unsigned_magic_for(divisor, bits);
+                auto* high = binary(ir::ir_opcode::UMULH, value, constant(magic.multiplier));
+                if (magic.add)
+                {
+                    auto* half = shift(ir::ir_opcode::LSHR, binary(ir::ir_opcode::SUB, value, high), 1);
+                    high = binary(ir::ir_opcode::ADD, high, half);
+                }
+
+                return shift(ir::ir_opcode::LSHR, high, magic.shift);
+            }
+
+            auto divide_signed(ir::ir_dag_node* value, uint64_t divisor) -> ir::ir_dag_node*
+            {
+                bool negative = sign_extend(divisor, bits) < 0;
+                uint64_t magnitude = (negative ? 0 - divisor : divisor) & width_mask(bits);
+                if (!std::has_single_bit(magnitude) || magnitude == 1)
+                {
+                    // -1 is not worth it, and would lose the trap on INT_MIN / -1
+                    return nullptr;
+                }
+
+                // negative dividends are biased by 2^k - 1 first, so the shift rounds towards zero
+                auto log = static_cast<size_t>(std::countr_zero(magnitude));
+                auto* sign = log == 1 ? value : shift(ir::ir_opcode::ASHR, value, bits - 1);
+                auto* bias = shift(ir::ir_opcode::LSHR, sign, bits - log);
+                auto* quotient = shift(ir::ir_opcode::ASHR, binary(ir::ir_opcode::ADD, value, bias), log);
+
+                return negative ? binary(ir::ir_opcode::SUB, constant(0), quotient) : quotient;
+            }
+        };
+    } // namespace
+
+    auto strength_reduction::transform(ir::ir_dag&& _dag) const -> result_t
+    {
+        ir::ir_dag dag = std::move(_dag);
+
+        for (auto* node : dag.post_order())
+        {
+            if (node->chain != nullptr || node->operands.size() != 2 || node->type.bit_width() == 0)
+            {
+                continue;
+            }
+
+            auto* lhs = node->operands[0];
+            auto* rhs = node->operands[1];
+            auto lhs_value = constant_of(lhs);
+            auto rhs_value = constant_of(rhs);
+
+            if (!rhs_value || lhs_value || *rhs_value <= 1)
+            {
+                // constant operands of MUL can be on either side
+                if (node->opcode != ir::ir_opcode::MUL || rhs_value || !lhs_value || *lhs_value <= 1)
+                {
+                    continue;
+                }
+                std::swap(lhs, rhs);
+                std::swap(lhs_value, rhs_value);
+            }
+
+            reducer reduce(dag, node->type);
+            ir::ir_dag_node* replacement = nullptr;
+            switch (node->opcode)
+            {
+            case ir::ir_opcode::MUL:
+                replacement = reduce.multiply(lhs, *rhs_value);
+                break;
+            case ir::ir_opcode::UDIV:
+                replacement = reduce.divide_unsigned(lhs, *rhs_value);
+                break;
+            case ir::ir_opcode::SDIV:
+                replacement = reduce.divide_signed(lhs, *rhs_value);
+                break;
+            default:
+                break;
+            }
+
+            if (replacement != nullptr)
+            {
+                dag.replace_all_uses_with(node, replacement);
+            }
+        }
+
+        return dag;
+    }
+} // namespace sbrt::passes::opt
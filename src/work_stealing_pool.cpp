@@ -0,0 +1,174 @@
+#include "work_stealing_pool.h"
+#include "common.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace sbrt
+{
+    work_stealing_pool::work_stealing_pool(size_t threads) : slices(std::make_unique<slice[]>(threads + 1)), participants(threads + 1)
+    {
+        workers.reserve(threads);
+        for (size_t i = 0; i < threads; i++)
+        {
+            workers.emplace_back([this, i]() { work(i); });
+        }
+    }
+
+    work_stealing_pool::~work_stealing_pool()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        start.notify_all();
+    }
+
+    auto work_stealing_pool::pop(size_t self, size_t& index) -> bool
+    {
+        auto& range = slices[self].range;
+        uint64_t current = range.load(std::memory_order_acquire);
+
+        while (true)
+        {
+            uint64_t begin = current >> 32;
+            uint64_t end = current & UINT32_MAX;
+            if (begin >= end)
+            {
+                return false;
+            }
+
+            if (range.compare_exchange_weak(current, pack(begin + 1, end), std::memory_order_acq_rel))
+            {
+                index = begin;
+                return true;
+            }
+        }
+    }
+
+    auto work_stealing_pool::steal(size_t self) -> bool
+    {
+        while (true)
+        {
+            size_t victim = participants;
+            uint64_t victim_range = 0;
+            uint64_t largest = 0;
+
+            for (size_t i = 0; i < participants; i++)
+            {
+                uint64_t current = slices[i].range.load(std::memory_order_acquire);
+                uint64_t left = (current & UINT32_MAX) - std::min(current >> 32, current & UINT32_MAX);
+                if (i != self && left > largest)
+                {
+                    victim = i;
+                    victim_range = current;
+                    largest = left;
+                }
+            }
+
+            if (victim == participants)
+            {
+                return false;
+            }
+
+            uint64_t begin = victim_range >> 32;
+            uint64_t end = victim_range & UINT32_MAX;
+            uint64_t split = end - (end - begin + 1) / 2;
+
+            // our own slice is empty, so nobody else writes to it
+            if (slices[victim].range.compare_exchange_strong(victim_range, pack(begin, split), std::memory_order_acq_rel))
+            {
+                slices[self].range.store(pack(split, end), std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    void work_stealing_pool::participate(size_t self)
+    {
+        size_t index = 0;
+        do
+        {
+            while (pop(self, index))
+            {
+                try
+                {
+                    (*body)(index);
+                }
+                catch (...)
+                {
+                    // escaping a worker would terminate; parallel_for rethrows it on the caller instead
+                    std::lock_guard lock(mutex);
+                    if (!thrown)
+                    {
+                        thrown = std::current_exception();
+                    }
+                }
+            }
+        } while (steal(self));
+    }
+
+    void work_stealing_pool::work(size_t self)
+    {
+        uint64_t seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock lock(mutex);
+                start.wait(lock, [&]() { return stopping || generation != seen; });
+                if (stopping)
+                {
+                    return;
+                }
+                seen = generation;
+            }
+
+            participate(self);
+
+            std::lock_guard lock(mutex);
+            if (--running == 0)
+            {
+                finished.notify_one();
+            }
+        }
+    }
+
+    void work_stealing_pool::parallel_for(size_t count, const std::function<void(size_t)>& fn)
+    {
+        sbrt_assert(submodule::MISC, count <= UINT32_MAX);
+
+        for (size_t i = 0; i < participants; i++)
+        {
+            slices[i].range.store(pack(count * i / participants, count * (i + 1) / participants), std::memory_order_relaxed);
+        }
+
+        {
+            std::lock_guard lock(mutex);
+            body = &fn;
+            running = workers.size() + 1;
+            generation++;
+        }
+        start.notify_all();
+
+        // the caller is the last participant
+        participate(participants - 1);
+
+        std::unique_lock lock(mutex);
+        if (--running != 0)
+        {
+            finished.wait(lock, [this]() { return running == 0; });
+        }
+        body = nullptr;
+
+        if (auto failure = std::exchange(thrown, nullptr))
+        {
+            std::rethrow_exception(failure);
+        }
+    }
+} // namespace sbrt
@@ -0,0 +1,163 @@
+#include "instr/ir.h"
+#include "pass/opt_util.h"
+#include "pass/strength_reduction_pass.h"
+#include <cstddef>
+#include <cstdint>
+#include <fmt/core.h>
+#include <optional>
+#include <vector>
+
+using namespace sbrt;
+using namespace sbrt::passes::opt;
+
+namespace
+{
+    struct reduced
+    {
+        ir::ir_dag dag;
+        bool changed;
+    };
+
+    constexpr auto type_of(size_t bits) -> ir::ir_types { return bits == 8 ? ir::ir_types::U8 : ir::ir_types::U16; }
+
+    /**
+     * Strength reduces `x <opcode> constant`, with x an opaque NONE leaf
+     */
+    auto reduce(ir::ir_opcode opcode, uint64_t constant, size_t bits) -> reduced
+    {
+        ir::ir_dag dag;
+        auto* value = dag.create(nullptr, ir::ir_opcode::NONE, type_of(bits));
+        auto* imm = dag.create(nullptr, ir::ir_opcode::IMM, type_of(bits), ir::ir_imm_type(constant));
+        dag.root(dag.create(nullptr, opcode, type_of(bits), value, imm));
+
+        auto result = strength_reduction{}.transform(std::move(dag));
+        if (!result)
+        {
+            fmt::print("strength reduction failed\n");
+            std::exit(1);
+        }
+
+        bool changed = result->root()->opcode != opcode;
+        return {std::move(*result), changed};
+    }
+
+    /**
+     * Runs a reduced dag on `x`, every node through evaluate
+     */
+    auto interpret(ir::ir_dag& dag, uint64_t x, size_t bits) -> std::optional<uint64_t>
+    {
+        std::vector<uint64_t> values(dag.max_node_id());
+        for (auto* node : dag.post_order())
+        {
+            if (node->opcode == ir::ir_opcode::NONE)
+            {
+                values[node->get_id()] = x;
+                continue;
+            }
+
+            if (auto constant = constant_of(node))
+            {
+                values[node->get_id()] = *constant;
+                continue;
+            }
+
+            auto value = evaluate(node->opcode, values[node->operands[0]->get_id()], values[node->operands[1]->get_id()], bits);
+            if (!value)
+            {
+                return std::nullopt;
+            }
+            values[node->get_id()] = *value;
+        }
+
+        return values[dag.root()->get_id()];
+    }
+
+    size_t failures = 0;
+
+    void check(ir::ir_opcode opcode, ir::ir_dag& dag, uint64_t constant, uint64_t x, size_t bits)
+    {
+        auto expected = evaluate(opcode, x, constant, bits);
+        auto actual = interpret(dag, x, bits);
+        if (expected && expected != actual)
+        {
+            if (failures++ < 16)
+            {
+                fmt::print("{}-bit op {} x = {:#x}, c = {:#x}: expected {:#x}, got {:#x}\n", bits, static_cast<int>(opcode), x, constant,
+                           *expected, actual.value_or(0));
+            }
+        }
+    }
+
+    /**
+     * Every constant against every x
+     */
+    auto check_exhaustive(ir::ir_opcode opcode, size_t bits) -> size_t
+    {
+        size_t reductions = 0;
+        for (uint64_t constant = 2; constant <= width_mask(bits); constant++)
+        {
+            auto [dag, changed] = reduce(opcode, constant, bits);
+            if (!changed)
+            {
+                continue;
+            }
+
+            reductions++;
+            for (uint64_t x = 0; x <= width_mask(bits); x++)
+            {
+                check(opcode, dag, constant, x, bits);
+            }
+        }
+
+        return reductions;
+    }
+
+    /**
+     * Every divisor, against the dividends on both sides of each step of the quotient. The reduced sequence is
+     * nondecreasing in x (umulh is, and so is t + ((x - t) >> 1) for t <= x), so agreeing on both sides of every step
+     * means agreeing on all of [0, 2^bits)
+     */
+    auto check_unsigned_steps(size_t bits) -> size_t
+    {
+        size_t reductions = 0;
+        for (uint64_t divisor = 2; divisor <= width_mask(bits); divisor++)
+        {
+            auto [dag, changed] = reduce(ir::ir_opcode::UDIV, divisor, bits);
+            if (!changed)
+            {
+                continue;
+            }
+
+            reductions++;
+            check(ir::ir_opcode::UDIV, dag, divisor, 0, bits);
+            check(ir::ir_opcode::UDIV, dag, divisor, width_mask(bits), bits);
+            for (uint64_t step = divisor; step <= width_mask(bits); step += divisor)
+            {
+                check(ir::ir_opcode::UDIV, dag, divisor, step - 1, bits);
+                check(ir::ir_opcode::UDIV, dag, divisor, step, bits);
+            }
+        }
+
+        return reductions;
+    }
+} // namespace
+
+auto main() -> int
+{
+    // 2..255 all reduce; for MUL only the handful of patterns the pass knows, and SDIV only +-2^k
+    size_t udiv8 = check_exhaustive(ir::ir_opcode::UDIV, 8);
+    size_t sdiv8 = check_exhaustive(ir::ir_opcode::SDIV, 8);
+    size_t mul8 = check_exhaustive(ir::ir_opcode::MUL, 8);
+    size_t sdiv16 = check_exhaustive(ir::ir_opcode::SDIV, 16);
+    size_t mul16 = check_exhaustive(ir::ir_opcode::MUL, 16);
+    size_t udiv16 = check_unsigned_steps(16);
+
+    if (udiv8 != 254 || sdiv8 != 13 || sdiv16 != 29 || udiv16 != 65534 || mul8 == 0 || mul16 == 0)
+    {
+        fmt::print("unexpected reduction counts: udiv {} {}, sdiv {} {}, mul {} {}\n", udiv8, udiv16, sdiv8, sdiv16, mul8, mul16);
+        failures++;
+    }
+
+    fmt::print("{} failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}